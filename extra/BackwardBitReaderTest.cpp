@@ -0,0 +1,173 @@
+/* Copyright (C) Teemu Suutari */
+
+// Checks BackwardBitReader::readBits against reading the stream one bit at a time, for both bit orders
+// and all the widths. Wider reads than 32 bits must fail.
+// Also checks that Imploder streams with too wide distance fields in the header are rejected
+// instead of decoded into garbage.
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <vector>
+
+#include <Buffer.hpp>
+#include <BackwardBitReader.hpp>
+#include <IMPDecompressor.hpp>
+
+class VectorBuffer : public Buffer
+{
+public:
+	VectorBuffer(size_t size) :
+		_data(size)
+	{
+		// nothing needed
+	}
+
+	virtual const uint8_t *data() const noexcept override { return _data.data(); }
+	virtual uint8_t *data() override { return _data.data(); }
+	virtual size_t size() const noexcept override { return _data.size(); }
+
+private:
+	std::vector<uint8_t>	_data;
+};
+
+static constexpr size_t dataSize=1024;
+
+template<bool MSBFirst>
+static uint32_t checkReadBits(const std::vector<uint8_t> &data,uint32_t seed)
+{
+	uint32_t failures=0;
+	BackwardBitReader<MSBFirst> reader(data.data(),data.size(),0);
+	// reference reader, bit index counts from the end of the data
+	size_t bitPos=0;
+	auto refBit=[&]()->uint32_t
+	{
+		uint8_t byte=data[data.size()-1-bitPos/8];
+		uint32_t shift=MSBFirst?7-bitPos%8:bitPos%8;
+		bitPos++;
+		return (byte>>shift)&1;
+	};
+
+	for (;;)
+	{
+		seed=seed*1103515245U+12345U;
+		uint32_t count=(seed>>16)%33;
+		if (bitPos+count>data.size()*8) break;
+		uint32_t expected=0;
+		for (uint32_t i=0;i<count;i++)
+		{
+			if (MSBFirst) expected=(expected<<1)|refBit();
+				else expected|=refBit()<<i;
+		}
+		uint32_t value=reader.readBits(count);
+		if (value!=expected)
+		{
+			fprintf(stderr,"readBits(%u) failed, MSBFirst %u at bit %zu\n",count,uint32_t(MSBFirst),bitPos);
+			failures++;
+		}
+	}
+
+	// running out fails
+	try
+	{
+		reader.readBits(uint32_t(data.size()*8-bitPos+1));
+		fprintf(stderr,"reading past the end succeeded, MSBFirst %u\n",uint32_t(MSBFirst));
+		failures++;
+	} catch (const Decompressor::DecompressionError&) {
+		// expected
+	}
+
+	// wider reads than 32 bits fail even when there is data left
+	for (uint32_t count=33;count<=64;count++)
+	{
+		BackwardBitReader<MSBFirst> wideReader(data.data(),data.size(),0);
+		try
+		{
+			wideReader.readBits(count);
+			fprintf(stderr,"readBits(%u) succeeded, MSBFirst %u\n",count,uint32_t(MSBFirst));
+			failures++;
+		} catch (const Decompressor::DecompressionError&) {
+			// expected
+		}
+	}
+	return failures;
+}
+
+// A minimal Imploder file: 2 literals followed by a match of 2 bytes from distance 1.
+// All the flag bits come from the anchor byte, thus the literals are bytes 15 and 14
+static std::vector<uint8_t> makeIMP(uint8_t distanceWidth)
+{
+	static constexpr uint32_t endOffset=0x10;
+	std::vector<uint8_t> ret(endOffset+0x32);
+	auto writeBE32=[&](size_t offset,uint32_t value)
+	{
+		for (uint32_t i=0;i<4;i++) ret[offset+i]=uint8_t(value>>(24-i*8));
+	};
+	writeBE32(0,FourCC('IMP!'));
+	writeBE32(4,4);					// raw size
+	writeBE32(8,endOffset);
+	ret[14]=0x5a;
+	ret[15]=0xa5;
+	writeBE32(endOffset+12,2);			// first literal count
+	ret[endOffset+16]=0x80;				// no extra byte at the end
+	ret[endOffset+17]=0x01;				// 7 zero bits
+	for (uint32_t i=0;i<12;i++) ret[endOffset+34+i]=distanceWidth;
+	uint32_t checksum=7;
+	for (uint32_t i=0;i<endOffset+0x2e;i+=2) checksum+=(uint32_t(ret[i])<<8)|ret[i+1];
+	writeBE32(endOffset+0x2e,checksum);
+	return ret;
+}
+
+static uint32_t checkIMPWidths()
+{
+	uint32_t failures=0;
+	for (uint32_t width=1;width<256;width++)
+	{
+		std::vector<uint8_t> file=makeIMP(uint8_t(width));
+		VectorBuffer packed(file.size());
+		for (size_t i=0;i<file.size();i++) packed[i]=file[i];
+		VectorBuffer raw(4);
+		bool ok=true;
+		try
+		{
+			IMPDecompressor decompressor(packed,true);
+			decompressor.decompress(raw,true);
+		} catch (const Decompressor::Error&) {
+			ok=false;
+		}
+		// zero distance bits, thus every width up to 24 gives the same result
+		if (width<=24)
+		{
+			if (!ok || raw[0]!=0x5a || raw[1]!=0x5a || raw[2]!=0x5a || raw[3]!=0xa5)
+			{
+				fprintf(stderr,"IMP distance width %u failed to decode\n",width);
+				failures++;
+			}
+		} else if (ok) {
+			fprintf(stderr,"IMP distance width %u was not rejected\n",width);
+			failures++;
+		}
+	}
+	return failures;
+}
+
+int main(int argc,char **argv)
+{
+	std::vector<uint8_t> data(dataSize);
+	uint32_t seed=1;
+	for (auto &it : data)
+	{
+		seed=seed*1103515245U+12345U;
+		it=uint8_t(seed>>16);
+	}
+
+	uint32_t failures=0;
+	for (uint32_t i=0;i<16;i++)
+	{
+		failures+=checkReadBits<true>(data,i);
+		failures+=checkReadBits<false>(data,i);
+	}
+	failures+=checkIMPWidths();
+	printf("%u failures\n",failures);
+	return failures?1:0;
+}
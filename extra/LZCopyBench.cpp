@@ -0,0 +1,75 @@
+/* Copyright (C) Teemu Suutari */
+
+// Microbenchmark of LZCopyForward and LZCopyBackward against the plain byte loop,
+// over typical match distances and lengths. Prints the copy speed in MB/s.
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <chrono>
+#include <vector>
+
+#include <LZCopy.hpp>
+
+static constexpr size_t bufferSize=1<<20;
+static constexpr size_t totalBytes=64<<20;
+
+// the distance is hidden from the compiler, so that the loop stays a byte loop
+static void byteCopyForward(uint8_t *dest,size_t distance,size_t count)
+{
+	volatile size_t d=distance;
+	const uint8_t *src=dest-d;
+	while (count--) *(dest++)=*(src++);
+}
+
+static void byteCopyBackward(uint8_t *destEnd,size_t distance,size_t count)
+{
+	volatile size_t d=distance;
+	const uint8_t *src=destEnd+d;
+	while (count--) *(--destEnd)=*(--src);
+}
+
+// the matches are laid out one after another through the buffer, like in a decompressor
+template<typename F>
+static double measure(F copy,size_t distance,size_t count,bool backward)
+{
+	std::vector<uint8_t> buffer(bufferSize);
+	for (size_t i=0;i<bufferSize;i++) buffer[i]=uint8_t(i*7+(i>>5));
+	size_t margin=distance+count;
+	size_t copied=0;
+	auto start=std::chrono::steady_clock::now();
+	while (copied<totalBytes)
+	{
+		for (size_t pos=margin;pos+margin<=bufferSize;pos+=count)
+		{
+			if (backward) copy(buffer.data()+bufferSize-pos,distance,count);
+				else copy(buffer.data()+pos,distance,count);
+			copied+=count;
+		}
+	}
+	std::chrono::duration<double> elapsed=std::chrono::steady_clock::now()-start;
+	// keep the result alive
+	volatile uint8_t sink=buffer[bufferSize/2];
+	(void)sink;
+	return double(copied)/elapsed.count()/1e6;
+}
+
+int main(int argc,char **argv)
+{
+	static const size_t distances[]={1,2,3,4,5,7,8,12,16,32,256,4096};
+	static const size_t counts[]={3,4,8,16,32,64,258};
+
+	printf("distance count  forward  byteloop  backward  byteloop (MB/s)\n");
+	for (auto distance : distances)
+	{
+		for (auto count : counts)
+		{
+			double forward=measure(LZCopyForward,distance,count,false);
+			double forwardBytes=measure(byteCopyForward,distance,count,false);
+			double backward=measure(LZCopyBackward,distance,count,true);
+			double backwardBytes=measure(byteCopyBackward,distance,count,true);
+			printf("%8zu %5zu %8.0f %9.0f %9.0f %9.0f\n",distance,count,forward,forwardBytes,backward,backwardBytes);
+		}
+	}
+	return 0;
+}
@@ -0,0 +1,78 @@
+/* Copyright (C) Teemu Suutari */
+
+// Exhaustive check of LZCopyForward and LZCopyBackward against the plain byte loop,
+// for all the distance, length and alignment combinations that reach the different copy paths.
+// Also checks that nothing outside of the match is written.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+#include <LZCopy.hpp>
+
+static constexpr size_t maxDistance=48;
+static constexpr size_t maxCount=130;
+static constexpr size_t maxAlign=8;
+static constexpr size_t guard=64;
+
+static void fillPattern(std::vector<uint8_t> &buffer,uint32_t seed)
+{
+	for (size_t i=0;i<buffer.size();i++)
+	{
+		seed=seed*1103515245U+12345U;
+		buffer[i]=uint8_t(seed>>16);
+	}
+}
+
+static bool checkForward(size_t distance,size_t count,size_t align)
+{
+	std::vector<uint8_t> ref(guard+maxDistance+maxAlign+maxCount+guard);
+	fillPattern(ref,uint32_t(distance*1000+count*10+align));
+	std::vector<uint8_t> test(ref);
+
+	size_t start=guard+maxDistance+align;
+	for (size_t i=0;i<count;i++) ref[start+i]=ref[start+i-distance];
+	LZCopyForward(test.data()+start,distance,count);
+	return ref==test;
+}
+
+static bool checkBackward(size_t distance,size_t count,size_t align)
+{
+	std::vector<uint8_t> ref(guard+maxCount+maxAlign+maxDistance+guard);
+	fillPattern(ref,uint32_t(distance*1000+count*10+align)^0x5555U);
+	std::vector<uint8_t> test(ref);
+
+	size_t end=guard+maxCount+align;
+	for (size_t i=1;i<=count;i++) ref[end-i]=ref[end-i+distance];
+	LZCopyBackward(test.data()+end,distance,count);
+	return ref==test;
+}
+
+int main(int argc,char **argv)
+{
+	uint32_t cases=0,failures=0;
+	for (size_t distance=1;distance<=maxDistance;distance++)
+	{
+		for (size_t count=0;count<=maxCount;count++)
+		{
+			for (size_t align=0;align<maxAlign;align++)
+			{
+				if (!checkForward(distance,count,align))
+				{
+					fprintf(stderr,"LZCopyForward failed: distance %zu count %zu alignment %zu\n",distance,count,align);
+					failures++;
+				}
+				if (!checkBackward(distance,count,align))
+				{
+					fprintf(stderr,"LZCopyBackward failed: distance %zu count %zu alignment %zu\n",distance,count,align);
+					failures++;
+				}
+				cases+=2;
+			}
+		}
+	}
+	printf("%u cases, %u failures\n",cases,failures);
+	return failures?1:0;
+}
@@ -3,124 +3,122 @@
 #include <memory>
 
 #include <stdint.h>
-#include <fstream>
 #include <vector>
 #include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <algorithm>
+#include <atomic>
 
 #include <stdio.h>
-#include <dirent.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <sys/stat.h>
 
 #include <Buffer.hpp>
-#include <SubBuffer.hpp>
 #include "Decompressor.hpp"
 
-class VectorBuffer : public Buffer
-{
-public:
-	VectorBuffer();
-
-	virtual ~VectorBuffer() override final;
-
-	virtual const uint8_t *data() const noexcept override final;
-	virtual uint8_t *data() override final;
-	virtual size_t size() const noexcept override final;
-
-	virtual bool isResizable() const noexcept override final;
-	virtual void resize(size_t newSize) override final;
-
-private:
-	std::vector<uint8_t>  _data;
-};
-
-VectorBuffer::VectorBuffer()
-{
-	// nothing needed
-}
-
-VectorBuffer::~VectorBuffer()
-{
-	// nothing needed
-}
-
-const uint8_t *VectorBuffer::data() const noexcept
-{
-	return _data.data();
-}
+#include "VectorBuffer.hpp"
+#include "LazyBuffer.hpp"
+#include "MappedBuffer.hpp"
+#include "FileIO.hpp"
+#include "BatchIO.hpp"
+#include "DirectoryWalker.hpp"
+#include "ScanFiles.hpp"
+#include "ScanIndex.hpp"
+#include "ScanPipeline.hpp"
+#include "Manifest.hpp"
 
-uint8_t *VectorBuffer::data()
+// Identifies the compression of a file with verification off. Only the beginning of the file is read,
+// if that is not enough for the header parsing the file is mapped and the parsing is retried.
+// With verify the whole file is read and its checksums are verified.
+// Returns false if the file can't be read, name is empty if the format is not known
+static bool identifyFile(const std::string &fileName,bool verify,std::string &name)
 {
-	return _data.data();
-}
-
-size_t VectorBuffer::size() const noexcept
-{
-	return _data.size();
-}
-
-bool VectorBuffer::isResizable() const noexcept
-{
-	return true;
-}
-
-void VectorBuffer::resize(size_t newSize) 
-{
-	return _data.resize(newSize);
-}
+	static constexpr size_t headerReadSize=0x1000U;
 
-std::unique_ptr<Buffer> readFile(const std::string &fileName)
-{
+	name.clear();
+	auto tryCreate=[&](const Buffer &packed)
+	{
+		try
+		{
+			name=Decompressor::create(packed,false,verify)->getName();
+		} catch (const Decompressor::Error&) {
+			// not known
+		}
+	};
 
-	std::unique_ptr<Buffer> ret=std::make_unique<VectorBuffer>();
-	std::ifstream file(fileName.c_str(),std::ios::in|std::ios::binary);
-	bool success=false;
-	if (file.is_open())
+	if (verify)
 	{
-		file.seekg(0,std::ios::end);
-		size_t length=size_t(file.tellg());
-		file.seekg(0,std::ios::beg);
-		ret->resize(length);
-		file.read(reinterpret_cast<char*>(ret->data()),length);
-		success=bool(file);
-		if (!success) ret->resize(0);
-		file.close();
+		auto packed{readFile(fileName)};
+		tryCreate(*packed);
+		return true;
 	}
-	if (!success)
+
+	int fd=::open(fileName.c_str(),O_RDONLY|O_CLOEXEC);
+	struct stat st;
+	if (fd<0 || ::fstat(fd,&st)<0)
 	{
+		if (fd>=0) ::close(fd);
 		fprintf(stderr,"Could not read file %s\n",fileName.c_str());
+		return false;
 	}
-	return ret;
-}
-
-bool writeFile(const std::string &fileName,const Buffer &content)
-{
-	bool ret=false;
-	std::ofstream file(fileName.c_str(),std::ios::out|std::ios::binary|std::ios::trunc);
-	if (file.is_open()) {
-		file.write(reinterpret_cast<const char*>(content.data()),content.size());
-		ret=bool(file);
-		file.close();
+	size_t fileSize=size_t(st.st_size);
+	VectorBuffer header;
+	header.resize(std::min(fileSize,headerReadSize));
+	size_t length=0;
+	while (length<header.size())
+	{
+		ssize_t ret=::pread(fd,header.data()+length,header.size()-length,off_t(length));
+		if (ret<=0) break;
+		length+=size_t(ret);
 	}
-	if (!ret)
+	header.resize(length);
+	tryCreate(header);
+	// some headers describe the whole stream (sizes checked against the file)
+	if (name.empty() && fileSize>length && Decompressor::detect(header))
 	{
-		fprintf(stderr,"Could not write file %s\n",fileName.c_str());
+		MappedBuffer mapped(fd,fileSize);
+		tryCreate(mapped);
 	}
-	return ret;
+	::close(fd);
+	return true;
 }
 
 int main(int argc,char **argv)
 {
 	auto usage=[]()
 	{
-		fprintf(stderr,"Usage: <prog> indentify input_packed\n");
-		fprintf(stderr," - identifies compression used in a file\n");
+		fprintf(stderr,"Usage: <prog> identify [--verify] [--threads n] input_packed_or_dir...\n");
+		fprintf(stderr," - identifies compression used in files, directories are scanned recursively.\n"
+			       " - only the headers are read and checked, unless --verify is given\n");
 		fprintf(stderr,"Usage: <prog> verify input_packed input_unpacked\n");
 		fprintf(stderr," - verifies decompression against known good unpacked file\n");
 		fprintf(stderr,"Usage: <prog> decompress input_packed output_raw\n");
 		fprintf(stderr," - decompresses single file\n");
 		fprintf(stderr,"Usage: <prog> scan input_dir output_dir\n");
 		fprintf(stderr," - scans input directory recursively and stores all found\n"
-			       " - known compressed streams to separate files in output directory\n");
+			       " - known compressed streams to separate files in output directory\n"
+			       " - scanned files are recorded into output_dir/scan.index, unchanged files are\n"
+			       " - not scanned again on later runs\n");
+		fprintf(stderr,"Usage: <prog> scan --manifest input_dir output_manifest\n");
+		fprintf(stderr," - scans input directory recursively and lists all found streams\n"
+			       " - into a manifest file, without copying them\n");
+		fprintf(stderr," - scan option --io uring|sync selects batched io_uring I/O (default, when available)\n"
+			       " - or plain blocking reads and writes\n");
+		fprintf(stderr," - scan option --threads n sets the number of threads (default: number of CPUs)\n");
+		fprintf(stderr," - scan option --recursive n scans also the decompressed streams, up to n levels deep\n");
+		fprintf(stderr," - scan option --shard i/n scans only the part i (starting from 0) of n of the files, partitioned\n"
+			       " - by the hash of their path. Index, stored files and manifest are named after the shard\n");
+		fprintf(stderr,"Usage: <prog> merge output_manifest input_manifest...\n");
+		fprintf(stderr," - combines manifests (e.g. of the scan shards) into one, ordered by the path\n");
+		fprintf(stderr,"Usage: <prog> extract input_manifest entry output_packed\n");
+		fprintf(stderr," - copies the stream of a manifest entry (starting from 0) from its source file\n");
+		fprintf(stderr,"Usage: <prog> unpack input_manifest entry output_raw\n");
+		fprintf(stderr," - decompresses the stream of a manifest entry directly from its source file\n");
 	};
 
 	if (argc<3)
@@ -132,23 +130,80 @@ int main(int argc,char **argv)
 
 	if (cmd=="identify")
 	{
-		if (argc!=3)
+		bool verify=false;
+		uint32_t threads=std::max(std::thread::hardware_concurrency(),1U);
+		std::vector<std::string> paths;
+		for (int i=2;i<argc;i++)
+		{
+			std::string arg=argv[i];
+			if (arg=="--verify")
+			{
+				verify=true;
+			} else if (arg=="--threads" && i+1<argc && atoi(argv[i+1])>0) {
+				threads=uint32_t(atoi(argv[++i]));
+			} else paths.push_back(arg);
+		}
+		if (paths.empty())
 		{
 			usage();
 			return -1;
 		}
-		auto packed{readFile(argv[2])};
-		std::unique_ptr<Decompressor> decompressor;
-		try
+		std::vector<std::string> files;
+		for (auto &path : paths)
 		{
-			decompressor=Decompressor::create(*packed,false,true);
-		} catch (const Decompressor::InvalidFormatError&)
+			struct stat st;
+			if (!::stat(path.c_str(),&st) && S_ISDIR(st.st_mode))
+			{
+				for (auto &it : DirectoryWalker::walk(path,threads,[](const std::string&) { return true; }))
+					files.push_back(std::move(it.name));
+			} else files.push_back(path);
+		}
+
+		// workers take the files in order, results are printed in the same order
+		enum class Result : uint8_t
 		{
-			fprintf(stderr,"Unknown or invalid compression format in file %s\n",argv[2]);
-			return -1;
+			Pending=0,
+			Known,
+			Unknown,
+			Failed
+		};
+		std::vector<Result> results(files.size(),Result::Pending);
+		std::vector<std::string> names(files.size());
+		std::atomic<size_t> next{0};
+		std::mutex mutex;
+		std::condition_variable condition;
+		auto worker=[&]()
+		{
+			for (size_t i;(i=next++)<files.size();)
+			{
+				std::string name;
+				Result result=identifyFile(files[i],verify,name)?(name.empty()?Result::Unknown:Result::Known):Result::Failed;
+				std::lock_guard<std::mutex> lock(mutex);
+				names[i]=std::move(name);
+				results[i]=result;
+				condition.notify_all();
+			}
+		};
+		std::vector<std::thread> workers;
+		for (uint32_t i=0;i<std::min(size_t(threads),files.size());i++)
+			workers.emplace_back(worker);
+
+		int ret=0;
+		for (size_t i=0;i<files.size();i++)
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			condition.wait(lock,[&]() { return results[i]!=Result::Pending; });
+			if (results[i]==Result::Known)
+			{
+				printf("Compression of %s is %s\n",files[i].c_str(),names[i].c_str());
+			} else {
+				if (results[i]==Result::Unknown) fprintf(stderr,"Unknown or invalid compression format in file %s\n",files[i].c_str());
+				ret=-1;
+			}
+			names[i].clear();
 		}
-		printf("Compression of %s is %s\n",argv[2],decompressor->getName().c_str());
-		return 0;
+		for (auto &it : workers) it.join();
+		return ret;
 	} else if (cmd=="decompress" || cmd=="verify") {
 		if (argc!=4)
 		{
@@ -170,7 +225,7 @@ int main(int argc,char **argv)
 			return -1;
 		}
 
-		std::unique_ptr<Buffer> raw=std::make_unique<VectorBuffer>();
+		std::unique_ptr<Buffer> raw=std::make_unique<LazyBuffer>();
 		raw->resize((decompressor->getRawSize())?decompressor->getRawSize():Decompressor::getMaxRawSize());
 		try
 		{
@@ -208,75 +263,205 @@ int main(int argc,char **argv)
 			return 0;
 		}
 	}
-	 else if (cmd=="scan") {
-		if (argc!=4)
+	 else if (cmd=="extract" || cmd=="unpack") {
+		if (argc!=5)
+		{
+			usage();
+			return -1;
+		}
+		std::vector<ManifestEntry> entries;
+		if (!readManifest(argv[2],entries)) return -1;
+		size_t entryIndex;
+		try
+		{
+			entryIndex=size_t(std::stoull(argv[3]));
+		} catch (const std::exception&) {
+			entryIndex=entries.size();
+		}
+		if (entryIndex>=entries.size())
+		{
+			fprintf(stderr,"No entry %s in manifest %s\n",argv[3],argv[2]);
+			return -1;
+		}
+		auto data{(cmd=="extract")?extractManifestEntry(entries,entryIndex):unpackManifestEntry(entries,entryIndex)};
+		if (!data) return -1;
+		return writeFile(argv[4],*data)?0:-1;
+	} else if (cmd=="merge") {
+		if (argc<4)
+		{
+			usage();
+			return -1;
+		}
+		return mergeManifests(argv[2],std::vector<std::string>(argv+3,argv+argc))?0:-1;
+	} else if (cmd=="scan") {
+		bool manifest=false;
+		BatchIO::Backend backend=BatchIO::Backend::IOUring;
+		uint32_t threads=std::max(std::thread::hardware_concurrency(),1U);
+		uint32_t recursion=0;
+		uint32_t shard=0,shardCount=0;
+		std::vector<std::string> args;
+		for (int i=2;i<argc;i++)
+		{
+			std::string arg=argv[i];
+			if (arg=="--manifest")
+			{
+				manifest=true;
+			} else if (arg=="--recursive" && i+1<argc && atoi(argv[i+1])>=0) {
+				recursion=uint32_t(atoi(argv[++i]));
+			} else if (arg=="--threads" && i+1<argc && atoi(argv[i+1])>0) {
+				threads=uint32_t(atoi(argv[++i]));
+			} else if (arg=="--shard" && i+1<argc && sscanf(argv[i+1],"%u/%u",&shard,&shardCount)==2 && shard<shardCount) {
+				i++;
+			} else if (arg=="--io" && i+1<argc && (std::string(argv[i+1])=="uring" || std::string(argv[i+1])=="sync")) {
+				backend=(std::string(argv[++i])=="uring")?BatchIO::Backend::IOUring:BatchIO::Backend::Sync;
+			} else args.push_back(arg);
+		}
+		if (args.size()!=2)
 		{
 			usage();
 			return -1;
 		}
-		uint32_t fileIndex=0;
-		std::function<void(std::string)> processDir=[&](std::string inputDir)
+
+		// Shards partition the files by the hash of their path relative to the input directory,
+		// thus the processes need no coordination. All their outputs have the shard in the name
+		std::string shardName;
+		if (shardCount) shardName="shard"+std::to_string(shard)+"of"+std::to_string(shardCount);
+		auto inShard=[&](const std::string &path)->bool
+		{
+			if (!shardCount) return true;
+			return pathHash(path.substr(std::min(args[0].size()+1,path.size())))%shardCount==shard;
+		};
+
+		auto io{BatchIO::create(backend,64)};
+		auto files{DirectoryWalker::walk(args[0],threads,inShard)};
+
+		if (manifest)
+		{
+			std::string manifestName=args[1];
+			if (shardCount) manifestName+="."+shardName;
+			std::unique_ptr<FILE,decltype(&::fclose)> manifestFile{::fopen(manifestName.c_str(),"w"),::fclose};
+			if (!manifestFile)
+			{
+				fprintf(stderr,"Could not write manifest %s\n",manifestName.c_str());
+				return -1;
+			}
+			writeManifestHeader(manifestFile.get());
+			size_t entryCount=0;
+			ScanPipeline pipeline(recursion,false,true,[&](ScanJob &job)
+			{
+				for (auto &it : job.streams)
+				{
+					printf("Found compressed stream at %zu, size %zu in %s with type '%s'\n",it.offset,it.packedSize,streamContainer(job.path,job.streams,it.parent).c_str(),it.name.c_str());
+					ManifestEntry entry{it.offset,it.packedSize,it.rawSize,it.hasRawCRC,it.rawCRC,it.name,job.path,it.parent!=0,0};
+					if (entry.hasParent) entry.parentEntry=entryCount-(&it-job.streams.data())+it.parent-1;
+					writeManifestEntry(manifestFile.get(),entry);
+					entryCount++;
+				}
+			});
+			readFiles(*io,files,[](const DirectoryWalker::File&) { return true; },[&](const DirectoryWalker::File &file,const Buffer *packed)
+			{
+				if (!packed) return;
+				auto job{pipeline.createJob(file.name)};
+				pipeline.scan(*job,*packed);
+				if (!job->streams.empty()) pipeline.push(std::move(job));
+			});
+			pipeline.finish();
+			return 0;
+		}
+
+		ScanIndex index(args[1]+(shardCount?"/scan."+shardName+".index":std::string("/scan.index")));
+		uint32_t fileIndex=index.getNextFileIndex();
+		auto outputName=[&](uint32_t index)->std::string
 		{
+			return args[1]+"/"+(shardCount?shardName+".":std::string())+"file"+std::to_string(index)+".pack";
+		};
+		// Files with found streams are added to the index only after their writes have completed
+		std::vector<std::pair<std::string,ScanIndex::Entry>> pendingEntries;
+		auto flushPending=[&]()
+		{
+			io->flush();
+			for (auto &it : pendingEntries)
+				index.add(it.first,it.second);
+			pendingEntries.clear();
+		};
 
-			std::unique_ptr<DIR,decltype(&::closedir)> dir{::opendir(inputDir.c_str()),::closedir};
-			if (dir)
+		ScanPipeline pipeline(recursion,true,false,[&](ScanJob &job)
+		{
+			if (job.replay)
 			{
-				while (struct dirent *de=::readdir(dir.get()))
+				for (auto &it : job.entry.streams)
+					printf("Found compressed stream at %zu, size %zu in %s with type '%s', already stored into %s\n",it.offset,it.packedSize,streamContainer(job.path,job.entry.streams,it.parent).c_str(),it.name.c_str(),outputName(it.fileIndex).c_str());
+				return;
+			}
+			// owners are numbered first, a copy can be before its owner in the same file
+			for (auto &it : job.streams)
+				if (!it.duplicate && it.record) it.record->fileIndex=fileIndex++;
+			for (auto &it : job.streams)
+			{
+				if (it.duplicate)
 				{
-					std::string subName(de->d_name);
-					if (subName=="." || subName=="..") continue;
-					std::string name=inputDir+"/"+subName;
-					struct stat st;
-					if (stat(name.c_str(),&st)<0) continue;
-					if (st.st_mode&S_IFDIR)
-					{
-						processDir(name);
-					} else if (st.st_mode&S_IFREG) {
-						auto packed{readFile(name)};
-						ConstSubBuffer scanBuffer(*packed,0,packed->size());
-						for (size_t i=0;i<packed->size();)
-						{
-							scanBuffer.adjust(i,packed->size()-i);
-							// We will detect first, before trying the format for real
-							if (!Decompressor::detect(scanBuffer))
-							{
-								i++;
-								continue;
-							}
-							try
-							{
-								auto decompressor{Decompressor::create(scanBuffer,false,true)};
-								std::unique_ptr<Buffer> raw=std::make_unique<VectorBuffer>();
-								raw->resize((decompressor->getRawSize())?decompressor->getRawSize():Decompressor::getMaxRawSize());
-								// for formats that do not encode packed size.
-								// we will get it from decompressor
-								if (!decompressor->getPackedSize())
-									decompressor->decompress(*raw,true);
-								if (decompressor->getPackedSize())
-								{
-									// final checks with the limited buffer and fresh decompressor
-									ConstSubBuffer finalBuffer(*packed,i,decompressor->getPackedSize());
-									auto decompressor2{Decompressor::create(finalBuffer,true,true)};
-									decompressor2->decompress(*raw,true);
-									std::string outputName=std::string(argv[3])+"/file"+std::to_string(fileIndex++)+".pack";
-									printf("Found compressed stream at %zu, size %zu in file %s with type '%s', storing it into %s\n",i,decompressor2->getPackedSize(),name.c_str(),decompressor2->getName().c_str(),outputName.c_str());
-									writeFile(outputName,finalBuffer);
-									i+=finalBuffer.size();
-									continue;
-								}
-							} catch (const Decompressor::Error&) {
-								// full steam ahead (with next offset)
-							}
-							i++;
-						}
-					}
+					job.entry.streams.push_back(ScanIndex::Stream{it.offset,it.packedSize,it.rawSize,true,it.hash,it.record->fileIndex,it.parent,it.name});
+					printf("Found compressed stream at %zu, size %zu in %s with type '%s', same as %s\n",it.offset,it.packedSize,streamContainer(job.path,job.streams,it.parent).c_str(),it.name.c_str(),outputName(it.record->fileIndex).c_str());
+					continue;
 				}
-			} else {
-				fprintf(stderr,"Could not process directory %s\n",inputDir.c_str());
+				job.entry.streams.push_back(ScanIndex::Stream{it.offset,it.packedSize,it.rawSize,true,it.hash,it.record?it.record->fileIndex:fileIndex++,it.parent,it.name});
+				std::string fileName=outputName(job.entry.streams.back().fileIndex);
+				printf("Found compressed stream at %zu, size %zu in %s with type '%s', storing it into %s\n",it.offset,it.packedSize,streamContainer(job.path,job.streams,it.parent).c_str(),it.name.c_str(),fileName.c_str());
+				io->queueWrite(fileName,std::move(it.packed));
+			}
+			pendingEntries.emplace_back(job.path,std::move(job.entry));
+			if (pendingEntries.size()>=64) flushPending();
+		});
+
+		// replaying is only possible while the stored streams are still there
+		auto isStored=[&](const ScanIndex::Entry &entry)->bool
+		{
+			for (auto &it : entry.streams)
+			{
+				struct stat st;
+				if (::stat(outputName(it.fileIndex).c_str(),&st) || !S_ISREG(st.st_mode) || uint64_t(st.st_size)!=it.packedSize) return false;
 			}
+			return true;
 		};
+		// unchanged files are not read at all. If only the timestamp differs, content decides.
+		// Files scanned with different recursion depth or with missing output files are scanned again
+		auto isUnchanged=[&](const DirectoryWalker::File &file)->bool
+		{
+			const ScanIndex::Entry *previous=index.find(file.name);
+			return previous && previous->size==uint64_t(file.st.st_size) && previous->mtime==int64_t(file.st.st_mtime) && previous->recursion==recursion && isStored(*previous);
+		};
+		readFiles(*io,files,[&](const DirectoryWalker::File &file) { return !isUnchanged(file); },[&](const DirectoryWalker::File &file,const Buffer *packed)
+		{
+			auto job{pipeline.createJob(file.name)};
 
-		processDir(std::string(argv[2]));
+			const ScanIndex::Entry *previous=index.find(file.name);
+			if (isUnchanged(file))
+			{
+				job->entry=*previous;
+				job->replay=true;
+				pipeline.remember(*job);
+				pipeline.push(std::move(job));
+				return;
+			}
+			// failed reads are scanned again next time
+			if (!packed) return;
+			job->entry=ScanIndex::Entry{packed->size(),int64_t(file.st.st_mtime),contentHash(*packed),recursion,{}};
+			if (previous && previous->size==job->entry.size && previous->hash==job->entry.hash && previous->recursion==recursion && isStored(*previous))
+			{
+				job->entry.streams=previous->streams;
+				job->replay=true;
+				index.add(file.name,job->entry);
+				pipeline.remember(*job);
+				pipeline.push(std::move(job));
+				return;
+			}
+			pipeline.scan(*job,*packed);
+			if (job->streams.empty()) index.add(file.name,job->entry);
+				else pipeline.push(std::move(job));
+		});
+		pipeline.finish();
+		flushPending();
+		index.compact();
 		return 0;
 	} else {
 		fprintf(stderr,"Unknown command\n");
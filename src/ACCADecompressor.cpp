@@ -1,6 +1,8 @@
 /* Copyright (C) Teemu Suutari */
 
 #include "ACCADecompressor.hpp"
+#include "FlagLZDecoder.hpp"
+#include "Span.hpp"
 
 bool ACCADecompressor::detectHeaderXPK(uint32_t hdr) noexcept
 {
@@ -30,98 +32,77 @@ const std::string &ACCADecompressor::getSubName() const noexcept
 	return name;
 }
 
-void ACCADecompressor::decompressImpl(Buffer &rawData,const Buffer &previousData,bool verify)
+struct ACCAPolicy
 {
-	// Stream reading
-	size_t packedSize=_packedData.size();
-	const uint8_t *bufPtr=_packedData.data();
-	size_t bufOffset=0;
-	uint16_t bufBitsContent=0;
-	uint8_t bufBitsLength=0;
-
-	auto readBit=[&]()->uint8_t
-	{
-		if (!bufBitsLength)
-		{
-			if (bufOffset+1>=packedSize) throw Decompressor::DecompressionError();
-			bufBitsContent=uint16_t(bufPtr[bufOffset++])<<8;
-			bufBitsContent|=uint16_t(bufPtr[bufOffset++]);
-			bufBitsLength=16;
-		}
-		uint8_t ret=bufBitsContent>>15;
-		bufBitsContent<<=1;
-		bufBitsLength--;
-		return ret;
-	};
+	static constexpr uint32_t wordBits=16;
+	static constexpr uint32_t tokenBits=1;
 
-	auto readByte=[&]()->uint8_t
+	static uint32_t readWord(FlagLZStream &stream)
 	{
-		if (bufOffset>=packedSize) throw Decompressor::DecompressionError();
-		return bufPtr[bufOffset++];
-	};
-
-	uint8_t *dest=rawData.data();
-	size_t destOffset=0;
-	size_t rawSize=rawData.size();
+		if (stream.offset+1>=stream.end) throw Decompressor::DecompressionError();
+		uint32_t ret=loadBE16(stream.ptr+stream.offset);
+		stream.offset+=2;
+		return ret;
+	}
 
-	while (destOffset!=rawSize)
+	static void decodeToken(FlagLZStream &stream,uint32_t token)
 	{
-		if (!readBit())
+		static const uint8_t staticBytes[16]={
+			0x00,0x01,0x02,0x03,0x04,0x08,0x10,0x20,
+			0x40,0x55,0x60,0x80,0xaa,0xc0,0xe0,0xff};
+
+		uint8_t tmp=stream.readByte();
+		uint32_t count=tmp&0xf;
+		uint32_t code=tmp>>4;
+		uint32_t distance=0;
+		uint8_t repeatChar=0;
+		bool doRLE=false;
+		switch (code)
+		{
+			case 0:
+			repeatChar=stream.readByte();
+			case 14:
+			count+=3;
+			doRLE=true;
+			break;
+
+			case 1:
+			count=(count|(uint32_t(stream.readByte())<<4))+19;
+			repeatChar=stream.readByte();
+			doRLE=true;
+			break;
+
+			case 2:
+			repeatChar=staticBytes[count];
+			count=2;
+			doRLE=true;
+			break;
+
+			case 15:
+			distance=(count|(uint32_t(stream.readByte())<<4))+3;
+			count=uint32_t(stream.readByte())+14;
+			break;
+
+			default: /* 3 to 13 */
+			distance=(count|(uint32_t(stream.readByte())<<4))+3;
+			count=code;
+			break;
+		}
+		if (doRLE)
 		{
-			dest[destOffset++]=readByte();
+			if (stream.destOffset+count>stream.rawSize) throw Decompressor::DecompressionError();
+			stream.fill(repeatChar,count);
 		} else {
-			static const uint8_t staticBytes[16]={
-				0x00,0x01,0x02,0x03,0x04,0x08,0x10,0x20,
-				0x40,0x55,0x60,0x80,0xaa,0xc0,0xe0,0xff};
-
-			uint8_t tmp=readByte();
-			uint32_t count=tmp&0xf;
-			uint32_t code=tmp>>4;
-			uint32_t distance=0;
-			uint8_t repeatChar=0;
-			bool doRLE=false;
-			switch (code)
-			{
-				case 0:
-				repeatChar=readByte();
-				case 14:
-				count+=3;
-				doRLE=true;
-				break;
-
-				case 1:
-				count=(count|(uint32_t(readByte())<<4))+19;
-				repeatChar=readByte();
-				doRLE=true;
-				break;
-
-				case 2:
-				repeatChar=staticBytes[count];
-				count=2;
-				doRLE=true;
-				break;
-
-				case 15:
-				distance=(count|(uint32_t(readByte())<<4))+3;
-				count=uint32_t(readByte())+14;
-				break;
-
-				default: /* 3 to 13 */
-				distance=(count|(uint32_t(readByte())<<4))+3;
-				count=code;
-				break;
-			}
-			if (doRLE)
-			{
-				if (destOffset+count>rawSize) throw Decompressor::DecompressionError();
-				for (uint32_t i=0;i<count;i++) dest[destOffset++]=repeatChar;
-			} else {
-				if (distance>destOffset || destOffset+count>rawSize) throw Decompressor::DecompressionError();
-				for (uint32_t i=0;i<count;i++,destOffset++)
-					dest[destOffset]=dest[destOffset-distance];
-			}
+			if (distance>stream.destOffset || stream.destOffset+count>stream.rawSize) throw Decompressor::DecompressionError();
+			stream.copy(distance,count);
 		}
 	}
+};
+
+void ACCADecompressor::decompressImpl(Buffer &rawData,const Buffer &previousData,bool verify)
+{
+	FlagLZStream stream{_packedData.data(),0,_packedData.size(),rawData.data(),0,rawData.size()};
+	FlagLZDecode<ACCAPolicy>(stream);
 }
 
 XPKDecompressor::Registry<ACCADecompressor> ACCADecompressor::_XPKregistration;
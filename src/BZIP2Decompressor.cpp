@@ -5,6 +5,7 @@
 
 #include "BZIP2Decompressor.hpp"
 #include "HuffmanDecoder.hpp"
+#include "Span.hpp"
 #include <CRC32.hpp>
 
 bool BZIP2Decompressor::detectHeader(uint32_t hdr) noexcept
@@ -17,6 +18,16 @@ bool BZIP2Decompressor::detectHeaderXPK(uint32_t hdr) noexcept
 	return (hdr==FourCC('BZP2'));
 }
 
+bool BZIP2Decompressor::probe(const Buffer &packedData,bool exactSizeKnown) noexcept
+{
+	// stream continues with either a block header or the end of stream marker (byte aligned at this point)
+	ConstSpan packed(packedData);
+	if (packed.size()<10) return false;
+	uint32_t high=packed.readBE32Unchecked(4);
+	uint16_t low=packed.readBE16Unchecked(8);
+	return (high==0x31415926U && low==0x5359U) || (high==0x17724538U && low==0x5090U);
+}
+
 std::unique_ptr<Decompressor> BZIP2Decompressor::create(const Buffer &packedData,bool exactSizeKnown,bool verify)
 {
 	return std::make_unique<BZIP2Decompressor>(packedData,exactSizeKnown,verify);
@@ -23,6 +23,7 @@ public:
 	virtual void decompressImpl(Buffer &rawData,const Buffer &previousData,bool verify) override final;
 
 	static bool detectHeader(uint32_t hdr) noexcept;
+	static bool probe(const Buffer &packedData,bool exactSizeKnown) noexcept;
 	static bool detectHeaderXPK(uint32_t hdr) noexcept;
 
 	static std::unique_ptr<Decompressor> create(const Buffer &packedData,bool exactSizeKnown,bool verify);
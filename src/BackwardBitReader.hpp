@@ -0,0 +1,180 @@
+/* Copyright (C) Teemu Suutari */
+
+#ifndef BACKWARDBITREADER_HPP
+#define BACKWARDBITREADER_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+// For exception
+#include "Decompressor.hpp"
+#include "Span.hpp"
+
+// Bit reader for the streams that are consumed from the end towards the start (PP, CRM, IMP, RNC1 old).
+// Bytes are taken from decreasing offsets, bits within a byte either from the lowest bit (MSBFirst=false)
+// or from the highest bit (MSBFirst=true).
+// The reader refills with whole 32-bit words while there is room for them, the last bytes before
+// minOffset are loaded one at a time. Running out of data throws DecompressionError only when the bits
+// are actually needed, prefetching never does.
+template<bool MSBFirst>
+class BackwardBitReader
+{
+public:
+	BackwardBitReader(const uint8_t *ptr,size_t offset,size_t minOffset) noexcept :
+		_ptr(ptr),
+		_offset(offset),
+		_minOffset(minOffset)
+	{
+		// nothing needed
+	}
+
+	BackwardBitReader(const BackwardBitReader&)=delete;
+	BackwardBitReader& operator=(const BackwardBitReader&)=delete;
+
+	~BackwardBitReader()
+	{
+		// nothing needed
+	}
+
+	// continue from a different memory area (offset downto 0) once the current one has been consumed
+	void setContinuation(const uint8_t *ptr,size_t offset) noexcept
+	{
+		_nextPtr=ptr;
+		_nextOffset=offset;
+	}
+
+	// puts the lowest length bits of value in front of the stream. value is in the stream bit order.
+	// only for an empty reader, length max 32
+	void preload(uint32_t value,uint32_t length) noexcept
+	{
+		if (!length) return;
+		value&=uint32_t((uint64_t(1)<<length)-1);
+		if (MSBFirst) _content=uint64_t(value)<<(64-length);
+			else _content=value;
+		_length=length;
+	}
+
+	// count max 32, a single refill does not load more
+	uint32_t readBits(uint32_t count)
+	{
+		if (!count) return 0;
+		if (count>32) throw Decompressor::DecompressionError();
+		if (_length<count) refill(count);
+		uint32_t ret;
+		if (MSBFirst)
+		{
+			ret=uint32_t(_content>>(64-count));
+			_content<<=count;
+		} else {
+			ret=uint32_t(_content&((uint64_t(1)<<count)-1));
+			_content>>=count;
+		}
+		_length-=count;
+		return ret;
+	}
+
+	// returns the next count bits without consuming them, count 1..32.
+	// Does not fail, the bits past the end of the data are zero
+	uint32_t peekBits(uint32_t count) noexcept
+	{
+		if (_length<count) fill(count);
+		if (MSBFirst) return uint32_t(_content>>(64-count));
+			else return uint32_t(_content&((uint64_t(1)<<count)-1));
+	}
+
+	uint8_t readBit()
+	{
+		if (!_length) refill(1);
+		uint8_t ret;
+		if (MSBFirst)
+		{
+			ret=uint8_t(_content>>63);
+			_content<<=1;
+		} else {
+			ret=uint8_t(_content&1);
+			_content>>=1;
+		}
+		_length--;
+		return ret;
+	}
+
+	// For the formats having bytes interleaved into the bit stream: returns the next byte that has not
+	// been touched by the bit reading. Already prefetched bytes are taken out from the middle of the
+	// accumulator, leaving the rest of partially read byte in place.
+	uint8_t readByte()
+	{
+		uint32_t partial=_length&7;
+		if (_length==partial)
+		{
+			if (_offset<=_minOffset && !nextSegment()) throw Decompressor::DecompressionError();
+			return _ptr[--_offset];
+		}
+		uint8_t ret;
+		if (MSBFirst)
+		{
+			ret=uint8_t(_content>>(56-partial));
+			uint64_t head=partial?_content&(~uint64_t(0)<<(64-partial)):0;
+			_content=head|((_content<<(partial+8))>>partial);
+		} else {
+			ret=uint8_t(_content>>partial);
+			_content=(_content&((uint64_t(1)<<partial)-1))|((_content>>(partial+8))<<partial);
+		}
+		_length-=8;
+		return ret;
+	}
+
+private:
+	void refill(uint32_t count)
+	{
+		if (!fill(count)) throw Decompressor::DecompressionError();
+	}
+
+	// loads at least count bits, returns false if the data runs out
+	bool fill(uint32_t count) noexcept
+	{
+		// _length<count<=32 here, thus a full word always fits
+		if (_offset>=_minOffset+4)
+		{
+			_offset-=4;
+			if (MSBFirst)
+			{
+				// byte from the highest offset goes first
+				_content|=uint64_t(loadLE32(_ptr+_offset))<<(32-_length);
+			} else {
+				_content|=uint64_t(loadBE32(_ptr+_offset))<<_length;
+			}
+			_length+=32;
+			return true;
+		}
+		while (_length<count)
+		{
+			if (_offset<=_minOffset && !nextSegment()) return false;
+			uint64_t tmp=_ptr[--_offset];
+			if (MSBFirst) _content|=tmp<<(56-_length);
+				else _content|=tmp<<_length;
+			_length+=8;
+		}
+		return true;
+	}
+
+	bool nextSegment() noexcept
+	{
+		if (!_nextPtr) return false;
+		_ptr=_nextPtr;
+		_offset=_nextOffset;
+		_minOffset=0;
+		_nextPtr=nullptr;
+		return _offset!=0;
+	}
+
+	const uint8_t	*_ptr;
+	size_t		_offset;
+	size_t		_minOffset;
+	const uint8_t	*_nextPtr=nullptr;
+	size_t		_nextOffset=0;
+
+	uint64_t	_content=0;
+	uint32_t	_length=0;
+};
+
+#endif
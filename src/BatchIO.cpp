@@ -0,0 +1,477 @@
+/* Copyright (C) Teemu Suutari */
+
+#include <deque>
+#include <vector>
+#include <algorithm>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define BATCHIO_HAS_IOURING 1
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#endif
+#endif
+
+#include "BatchIO.hpp"
+
+BatchIO::~BatchIO()
+{
+	// nothing needed
+}
+
+static int openRead(const std::string &fileName)
+{
+	int fd=::open(fileName.c_str(),O_RDONLY|O_CLOEXEC);
+	if (fd<0) fprintf(stderr,"Could not read file %s\n",fileName.c_str());
+	return fd;
+}
+
+static int openWrite(const std::string &fileName)
+{
+	int fd=::open(fileName.c_str(),O_WRONLY|O_CREAT|O_TRUNC|O_CLOEXEC,0644);
+	if (fd<0) fprintf(stderr,"Could not write file %s\n",fileName.c_str());
+	return fd;
+}
+
+// pread/pwrite, everything is done already when queued
+class SyncBatchIO : public BatchIO
+{
+public:
+	SyncBatchIO();
+	virtual ~SyncBatchIO();
+
+	virtual Backend getBackend() const noexcept override final;
+
+	virtual void queueRead(const std::string &fileName,Buffer &dest) override final;
+	virtual bool waitRead() override final;
+
+	virtual void queueWrite(const std::string &fileName,std::unique_ptr<Buffer> content) override final;
+	virtual bool flush() override final;
+
+private:
+	static bool transfer(int fd,uint8_t *ptr,size_t length,bool isWrite);
+
+	std::deque<bool>	_readResults;
+	bool			_writesOk=true;
+};
+
+SyncBatchIO::SyncBatchIO()
+{
+	// nothing needed
+}
+
+SyncBatchIO::~SyncBatchIO()
+{
+	// nothing needed
+}
+
+BatchIO::Backend SyncBatchIO::getBackend() const noexcept
+{
+	return Backend::Sync;
+}
+
+bool SyncBatchIO::transfer(int fd,uint8_t *ptr,size_t length,bool isWrite)
+{
+	size_t offset=0;
+	while (offset!=length)
+	{
+		ssize_t ret=isWrite?::pwrite(fd,ptr+offset,length-offset,off_t(offset)): ::pread(fd,ptr+offset,length-offset,off_t(offset));
+		if (ret<0 && errno==EINTR) continue;
+		if (ret<=0) return false;
+		offset+=size_t(ret);
+	}
+	return true;
+}
+
+void SyncBatchIO::queueRead(const std::string &fileName,Buffer &dest)
+{
+	int fd=openRead(fileName);
+	bool success=fd>=0 && transfer(fd,dest.data(),dest.size(),false);
+	if (fd>=0) ::close(fd);
+	if (fd>=0 && !success) fprintf(stderr,"Could not read file %s\n",fileName.c_str());
+	_readResults.push_back(success);
+}
+
+bool SyncBatchIO::waitRead()
+{
+	if (_readResults.empty()) return false;
+	bool ret=_readResults.front();
+	_readResults.pop_front();
+	return ret;
+}
+
+void SyncBatchIO::queueWrite(const std::string &fileName,std::unique_ptr<Buffer> content)
+{
+	int fd=openWrite(fileName);
+	bool success=fd>=0 && transfer(fd,content->data(),content->size(),true);
+	if (fd>=0 && ::close(fd)) success=false;
+	if (fd>=0 && !success) fprintf(stderr,"Could not write file %s\n",fileName.c_str());
+	_writesOk&=success;
+}
+
+bool SyncBatchIO::flush()
+{
+	bool ret=_writesOk;
+	_writesOk=true;
+	return ret;
+}
+
+#ifdef BATCHIO_HAS_IOURING
+
+// io_uring through the raw system calls, no need for liburing.
+// Files are opened and closed synchronously, the transfers themselves are asynchronous.
+// Short transfers are continued with a new request. When the ring itself fails, the error is reported
+// once and the operations the kernel has not taken yet, as well as all the later ones, fail
+class IOUringBatchIO : public BatchIO
+{
+public:
+	IOUringBatchIO();
+	virtual ~IOUringBatchIO();
+
+	// false if io_uring is not usable
+	bool init(uint32_t depth);
+
+	virtual Backend getBackend() const noexcept override final;
+
+	virtual void queueRead(const std::string &fileName,Buffer &dest) override final;
+	virtual bool waitRead() override final;
+
+	virtual void queueWrite(const std::string &fileName,std::unique_ptr<Buffer> content) override final;
+	virtual bool flush() override final;
+
+private:
+	struct Operation
+	{
+		std::string		fileName;
+		int			fd=-1;
+		bool			isWrite=false;
+		bool			done=false;
+		bool			failed=false;
+		uint8_t			*ptr=nullptr;
+		size_t			length=0;
+		size_t			offset=0;
+		std::unique_ptr<Buffer>	content;
+	};
+
+	uint32_t allocate();
+	void release(uint32_t id);
+	void start(uint32_t id);
+	void submit(uint32_t id);
+	void enter(uint32_t minComplete);
+	void failUnsubmitted();
+	void reap();
+	void complete(uint32_t id,int32_t result);
+	void finishWrite(uint32_t id);
+
+	int			_ringFd=-1;
+	uint32_t		_entries=0;
+
+	void			*_sqRing=MAP_FAILED;
+	void			*_cqRing=MAP_FAILED;
+	size_t			_sqRingSize=0;
+	size_t			_cqRingSize=0;
+	io_uring_sqe		*_sqes=static_cast<io_uring_sqe*>(MAP_FAILED);
+	size_t			_sqesSize=0;
+
+	uint32_t		*_sqTail=nullptr;
+	uint32_t		_sqMask=0;
+	uint32_t		*_sqArray=nullptr;
+	uint32_t		*_cqHead=nullptr;
+	uint32_t		*_cqTail=nullptr;
+	uint32_t		_cqMask=0;
+	io_uring_cqe		*_cqes=nullptr;
+
+	uint32_t		_unsubmitted=0;
+	uint32_t		_inFlight=0;
+	bool			_broken=false;
+
+	std::vector<Operation>	_operations;
+	std::vector<uint32_t>	_freeOperations;
+	std::deque<uint32_t>	_reads;
+	uint32_t		_pendingWrites=0;
+	bool			_writesOk=true;
+};
+
+IOUringBatchIO::IOUringBatchIO()
+{
+	// nothing needed
+}
+
+IOUringBatchIO::~IOUringBatchIO()
+{
+	if (_ringFd>=0)
+	{
+		// kernel must not write to the buffers after they are gone
+		while (_inFlight) enter(1);
+		for (auto &it : _operations)
+			if (it.fd>=0) ::close(it.fd);
+	}
+	if (_sqes!=MAP_FAILED) ::munmap(_sqes,_sqesSize);
+	if (_cqRing!=MAP_FAILED && _cqRing!=_sqRing) ::munmap(_cqRing,_cqRingSize);
+	if (_sqRing!=MAP_FAILED) ::munmap(_sqRing,_sqRingSize);
+	if (_ringFd>=0) ::close(_ringFd);
+}
+
+bool IOUringBatchIO::init(uint32_t depth)
+{
+	io_uring_params params;
+	::memset(&params,0,sizeof(params));
+	_ringFd=int(::syscall(__NR_io_uring_setup,depth,&params));
+	if (_ringFd<0) return false;
+	// IORING_OP_READ/WRITE came together with this feature
+	if (!(params.features&IORING_FEAT_RW_CUR_POS)) return false;
+
+	_entries=params.sq_entries;
+	_sqRingSize=params.sq_off.array+params.sq_entries*sizeof(uint32_t);
+	_cqRingSize=params.cq_off.cqes+params.cq_entries*sizeof(io_uring_cqe);
+	bool singleMap=(params.features&IORING_FEAT_SINGLE_MMAP)?true:false;
+	if (singleMap) _sqRingSize=_cqRingSize=std::max(_sqRingSize,_cqRingSize);
+
+	_sqRing=::mmap(nullptr,_sqRingSize,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,_ringFd,IORING_OFF_SQ_RING);
+	if (_sqRing==MAP_FAILED) return false;
+	_cqRing=singleMap?_sqRing: ::mmap(nullptr,_cqRingSize,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,_ringFd,IORING_OFF_CQ_RING);
+	if (_cqRing==MAP_FAILED) return false;
+	_sqesSize=params.sq_entries*sizeof(io_uring_sqe);
+	_sqes=static_cast<io_uring_sqe*>(::mmap(nullptr,_sqesSize,PROT_READ|PROT_WRITE,MAP_SHARED|MAP_POPULATE,_ringFd,IORING_OFF_SQES));
+	if (_sqes==MAP_FAILED) return false;
+
+	uint8_t *sq=static_cast<uint8_t*>(_sqRing);
+	uint8_t *cq=static_cast<uint8_t*>(_cqRing);
+	_sqTail=reinterpret_cast<uint32_t*>(sq+params.sq_off.tail);
+	_sqMask=*reinterpret_cast<uint32_t*>(sq+params.sq_off.ring_mask);
+	_sqArray=reinterpret_cast<uint32_t*>(sq+params.sq_off.array);
+	_cqHead=reinterpret_cast<uint32_t*>(cq+params.cq_off.head);
+	_cqTail=reinterpret_cast<uint32_t*>(cq+params.cq_off.tail);
+	_cqMask=*reinterpret_cast<uint32_t*>(cq+params.cq_off.ring_mask);
+	_cqes=reinterpret_cast<io_uring_cqe*>(cq+params.cq_off.cqes);
+	return true;
+}
+
+BatchIO::Backend IOUringBatchIO::getBackend() const noexcept
+{
+	return Backend::IOUring;
+}
+
+uint32_t IOUringBatchIO::allocate()
+{
+	if (_freeOperations.empty())
+	{
+		_operations.emplace_back();
+		return uint32_t(_operations.size()-1);
+	}
+	uint32_t ret=_freeOperations.back();
+	_freeOperations.pop_back();
+	return ret;
+}
+
+void IOUringBatchIO::release(uint32_t id)
+{
+	Operation &op=_operations[id];
+	if (op.fd>=0) ::close(op.fd);
+	op=Operation();
+	_freeOperations.push_back(id);
+}
+
+// submits the whole transfer, or completes it right away when there is nothing to do
+void IOUringBatchIO::start(uint32_t id)
+{
+	Operation &op=_operations[id];
+	if (op.fd<0)
+	{
+		op.failed=true;
+		op.done=true;
+	} else if (!op.length) {
+		op.done=true;
+	} else {
+		submit(id);
+		return;
+	}
+	if (op.isWrite) finishWrite(id);
+}
+
+void IOUringBatchIO::submit(uint32_t id)
+{
+	// nothing new after the ring has failed
+	if (_broken)
+	{
+		complete(id,-EIO);
+		return;
+	}
+	// there is always a free completion entry for everything in flight
+	while (_inFlight>=_entries) enter(1);
+
+	Operation &op=_operations[id];
+	uint32_t tail=*_sqTail;
+	uint32_t index=tail&_sqMask;
+	io_uring_sqe &sqe=_sqes[index];
+	::memset(&sqe,0,sizeof(sqe));
+	sqe.opcode=op.isWrite?IORING_OP_WRITE:IORING_OP_READ;
+	sqe.fd=op.fd;
+	sqe.addr=uint64_t(uintptr_t(op.ptr+op.offset));
+	sqe.len=uint32_t(std::min(op.length-op.offset,size_t(0x4000'0000U)));
+	sqe.off=op.offset;
+	sqe.user_data=id;
+	_sqArray[index]=index;
+	__atomic_store_n(_sqTail,tail+1,__ATOMIC_RELEASE);
+	_unsubmitted++;
+	_inFlight++;
+	if (_unsubmitted==_entries) enter(0);
+}
+
+void IOUringBatchIO::enter(uint32_t minComplete)
+{
+	uint32_t flags=minComplete?IORING_ENTER_GETEVENTS:0;
+	int ret=int(::syscall(__NR_io_uring_enter,_ringFd,_unsubmitted,minComplete,flags,nullptr,0));
+	if (ret>=0)
+	{
+		// the kernel can consume fewer entries than given, the rest are submitted on the next call
+		_unsubmitted-=std::min(uint32_t(ret),_unsubmitted);
+	} else if (errno!=EINTR && errno!=EAGAIN && errno!=EBUSY) {
+		if (!_broken)
+		{
+			fprintf(stderr,"I/O failed: %s\n",strerror(errno));
+			_broken=true;
+			failUnsubmitted();
+		} else {
+			// the consumed entries still complete, the sleep also lets the kernel post them
+			::usleep(1000);
+		}
+	}
+	reap();
+}
+
+// takes back the entries the kernel has not seen and fails their operations
+void IOUringBatchIO::failUnsubmitted()
+{
+	uint32_t tail=*_sqTail;
+	std::vector<uint32_t> ids;
+	for (uint32_t i=_unsubmitted;i;i--)
+		ids.push_back(uint32_t(_sqes[(tail-i)&_sqMask].user_data));
+	__atomic_store_n(_sqTail,tail-_unsubmitted,__ATOMIC_RELEASE);
+	_inFlight-=_unsubmitted;
+	_unsubmitted=0;
+	for (auto id : ids) complete(id,-EIO);
+}
+
+void IOUringBatchIO::reap()
+{
+	// completing can resubmit, which can reap recursively. Thus head is always re-read
+	for (;;)
+	{
+		uint32_t head=*_cqHead;
+		if (head==__atomic_load_n(_cqTail,__ATOMIC_ACQUIRE)) break;
+		const io_uring_cqe &cqe=_cqes[head&_cqMask];
+		uint32_t id=uint32_t(cqe.user_data);
+		int32_t result=cqe.res;
+		__atomic_store_n(_cqHead,head+1,__ATOMIC_RELEASE);
+		_inFlight--;
+		complete(id,result);
+	}
+}
+
+void IOUringBatchIO::complete(uint32_t id,int32_t result)
+{
+	Operation &op=_operations[id];
+	if (result==-EINTR || result==-EAGAIN)
+	{
+		submit(id);
+		return;
+	}
+	if (result<=0)
+	{
+		op.failed=true;
+	} else {
+		op.offset+=size_t(result);
+		if (op.offset!=op.length)
+		{
+			submit(id);
+			return;
+		}
+	}
+	op.done=true;
+	if (op.isWrite) finishWrite(id);
+}
+
+void IOUringBatchIO::finishWrite(uint32_t id)
+{
+	Operation &op=_operations[id];
+	// failed open has been reported already
+	if (op.fd>=0)
+	{
+		if (::close(op.fd)) op.failed=true;
+		if (op.failed) fprintf(stderr,"Could not write file %s\n",op.fileName.c_str());
+	}
+	op.fd=-1;
+	_writesOk&=!op.failed;
+	_pendingWrites--;
+	release(id);
+}
+
+void IOUringBatchIO::queueRead(const std::string &fileName,Buffer &dest)
+{
+	uint32_t id=allocate();
+	Operation &op=_operations[id];
+	op.fileName=fileName;
+	op.fd=openRead(fileName);
+	op.ptr=dest.data();
+	op.length=dest.size();
+	_reads.push_back(id);
+	start(id);
+}
+
+bool IOUringBatchIO::waitRead()
+{
+	if (_reads.empty()) return false;
+	uint32_t id=_reads.front();
+	_reads.pop_front();
+	while (!_operations[id].done) enter(1);
+	Operation &op=_operations[id];
+	bool ret=!op.failed;
+	if (op.fd>=0 && op.failed) fprintf(stderr,"Could not read file %s\n",op.fileName.c_str());
+	release(id);
+	return ret;
+}
+
+void IOUringBatchIO::queueWrite(const std::string &fileName,std::unique_ptr<Buffer> content)
+{
+	uint32_t id=allocate();
+	Operation &op=_operations[id];
+	op.fileName=fileName;
+	op.fd=openWrite(fileName);
+	op.isWrite=true;
+	op.ptr=content->data();
+	op.length=content->size();
+	op.content=std::move(content);
+	_pendingWrites++;
+	start(id);
+}
+
+bool IOUringBatchIO::flush()
+{
+	while (_pendingWrites) enter(1);
+	bool ret=_writesOk;
+	_writesOk=true;
+	return ret;
+}
+
+#endif
+
+std::unique_ptr<BatchIO> BatchIO::create(Backend backend,uint32_t depth)
+{
+#ifdef BATCHIO_HAS_IOURING
+	if (backend==Backend::IOUring)
+	{
+		auto ret=std::make_unique<IOUringBatchIO>();
+		if (ret->init(depth)) return ret;
+	}
+#endif
+	return std::make_unique<SyncBatchIO>();
+}
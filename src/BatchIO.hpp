@@ -0,0 +1,53 @@
+/* Copyright (C) Teemu Suutari */
+
+#ifndef BATCHIO_HPP
+#define BATCHIO_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <memory>
+
+#include <Buffer.hpp>
+
+// Batched file I/O for the command line tool.
+// Reads are queued ahead of the processing and they complete in the order they were queued.
+// Writes are fire-and-forget until flush, which reports whether all of them succeeded.
+// Two backends: io_uring (Linux) where many operations are in flight at the same time,
+// and plain pread/pwrite which does everything immediately when queued.
+class BatchIO
+{
+public:
+	enum class Backend
+	{
+		Sync=0,
+		IOUring
+	};
+
+	BatchIO()=default;
+
+	BatchIO(const BatchIO&)=delete;
+	BatchIO& operator=(const BatchIO&)=delete;
+
+	virtual ~BatchIO();
+
+	virtual Backend getBackend() const noexcept=0;
+
+	// Reads dest.size() bytes from the start of the file into dest.
+	// dest must stay alive until the read has been waited for
+	virtual void queueRead(const std::string &fileName,Buffer &dest)=0;
+	// waits for the oldest queued read, returns false if it failed
+	virtual bool waitRead()=0;
+
+	// the content is owned by the BatchIO until the write has completed
+	virtual void queueWrite(const std::string &fileName,std::unique_ptr<Buffer> content)=0;
+	// waits for all the queued writes, returns false if any of them failed since the previous flush
+	virtual bool flush()=0;
+
+	// falls back to Sync if io_uring is not available.
+	// depth is the maximum number of operations in flight
+	static std::unique_ptr<BatchIO> create(Backend backend,uint32_t depth);
+};
+
+#endif
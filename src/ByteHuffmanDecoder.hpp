@@ -0,0 +1,185 @@
+/* Copyright (C) Teemu Suutari */
+
+#ifndef BYTEHUFFMANDECODER_HPP
+#define BYTEHUFFMANDECODER_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+// For exception
+#include "Decompressor.hpp"
+#include "HuffmanDecoder.hpp"
+
+// Order-0 Huffman decoder for bytes in a MSB first bit stream (HUFF, HFMN, SMPL).
+// The codes are inserted into a HuffmanDecoder tree, which validates them. The codes up to tableBits
+// long are decoded from a lookup table, which also gives a second symbol when both codes fit within
+// the looked up bits. Longer codes and invalid bit patterns are decoded with the tree.
+class ByteHuffmanDecoder
+{
+public:
+	ByteHuffmanDecoder()
+	{
+		// nothing needed
+	}
+
+	ByteHuffmanDecoder(const ByteHuffmanDecoder&)=delete;
+	ByteHuffmanDecoder& operator=(const ByteHuffmanDecoder&)=delete;
+
+	~ByteHuffmanDecoder()
+	{
+		// nothing needed
+	}
+
+	void insert(const HuffmanCode<uint32_t> &code)
+	{
+		_tree.insert(code);
+		if (code.length<=tableBits) _codes.push_back(code);
+	}
+
+	// Decodes rawSize bytes starting from bufOffset. The bits left from the previous byte are the lowest
+	// bitsLength bits of bits. With delta the output is the running sum of the decoded values.
+	// Runs out of the data the same way as the tree would: nothing is written for the failing symbol
+	template<bool delta>
+	void decode(uint8_t *dest,size_t rawSize,const uint8_t *bufPtr,size_t bufOffset,size_t packedSize,uint32_t bits,uint32_t bitsLength)
+	{
+		createTable(delta);
+
+		uint64_t bufBitsContent=bits;
+		uint32_t bufBitsLength=bitsLength;
+
+		auto refill=[&]()
+		{
+			if (bufOffset+8<=packedSize)
+			{
+				uint32_t count=(63-bufBitsLength)>>3;
+				if (!count) return;
+				uint64_t word=0;
+				for (uint32_t i=0;i<8;i++)
+					word=(word<<8)|bufPtr[bufOffset+i];
+				bufBitsContent=(bufBitsContent<<(count*8))|(word>>(64-count*8));
+				bufBitsLength+=count*8;
+				bufOffset+=count;
+				return;
+			}
+			while (bufBitsLength<=56 && bufOffset<packedSize)
+			{
+				bufBitsContent=(bufBitsContent<<8)|bufPtr[bufOffset++];
+				bufBitsLength+=8;
+			}
+		};
+
+		auto readBit=[&]()->uint32_t
+		{
+			if (!bufBitsLength)
+			{
+				refill();
+				if (!bufBitsLength) throw Decompressor::DecompressionError();
+			}
+			return uint32_t(bufBitsContent>>(--bufBitsLength))&1;
+		};
+
+		size_t destOffset=0;
+		uint8_t accum=0;
+
+		auto decodeTree=[&]()
+		{
+			uint8_t value=_tree.decode(readBit);
+			if (delta) value=accum+=value;
+			dest[destOffset++]=value;
+		};
+
+		// room for two symbols
+		while (rawSize-destOffset>=2)
+		{
+			if (bufBitsLength<tableBits)
+			{
+				refill();
+				if (bufBitsLength<tableBits) break;
+			}
+			uint32_t entry=_table[uint32_t(bufBitsContent>>(bufBitsLength-tableBits))&((1U<<tableBits)-1)];
+			if (!entry)
+			{
+				decodeTree();
+				continue;
+			}
+			uint8_t first=uint8_t(entry),second=uint8_t(entry>>8);
+			if (delta)
+			{
+				first+=accum;
+				second+=accum;
+			}
+			dest[destOffset]=first;
+			uint32_t length=entry>>20;
+			bufBitsLength-=length;
+			if (length!=((entry>>16)&15))
+			{
+				dest[destOffset+1]=second;
+				if (delta) accum=second;
+				destOffset+=2;
+			} else {
+				if (delta) accum=first;
+				destOffset++;
+			}
+		}
+
+		// end of the stream or the output, one symbol at a time. past the end of the stream the bits are zero
+		while (destOffset!=rawSize)
+		{
+			if (bufBitsLength<tableBits) refill();
+			uint32_t index=(bufBitsLength>=tableBits)?uint32_t(bufBitsContent>>(bufBitsLength-tableBits)):uint32_t(bufBitsContent<<(tableBits-bufBitsLength));
+			uint32_t entry=_table[index&((1U<<tableBits)-1)];
+			uint32_t length=(entry>>16)&15;
+			if (!entry || length>bufBitsLength)
+			{
+				decodeTree();
+				continue;
+			}
+			uint8_t value=uint8_t(entry);
+			if (delta) value=accum+=value;
+			dest[destOffset++]=value;
+			bufBitsLength-=length;
+		}
+	}
+
+private:
+	static constexpr uint32_t tableBits=12;
+
+	// entries are first|(second<<8)|(firstLength<<16)|(totalLength<<20), 0 when the tree is needed.
+	// with delta, second is the sum of the both values
+	void createTable(bool delta)
+	{
+		std::vector<uint32_t> single(1U<<tableBits,0);
+		for (auto &it : _codes)
+		{
+			uint32_t code=uint32_t(it.code)&((1U<<it.length)-1);
+			uint32_t shift=tableBits-it.length;
+			for (uint32_t i=code<<shift;i<((code+1)<<shift);i++)
+				single[i]=it.value|(it.length<<16);
+		}
+		_table.assign(1U<<tableBits,0);
+		for (uint32_t i=0;i<(1U<<tableBits);i++)
+		{
+			uint32_t first=single[i];
+			if (!first) continue;
+			uint32_t firstLength=first>>16;
+			uint32_t second=single[(i<<firstLength)&((1U<<tableBits)-1)];
+			uint32_t secondLength=second>>16;
+			if (second && firstLength+secondLength<=tableBits)
+			{
+				uint8_t value=uint8_t(second);
+				if (delta) value+=uint8_t(first);
+				_table[i]=first|(value<<8)|(firstLength<<16)|((firstLength+secondLength)<<20);
+			} else {
+				_table[i]=first|(firstLength<<16)|(firstLength<<20);
+			}
+		}
+	}
+
+	HuffmanDecoder<uint32_t,256,0>		_tree;
+	std::vector<HuffmanCode<uint32_t>>	_codes;
+	std::vector<uint32_t>			_table;
+};
+
+#endif
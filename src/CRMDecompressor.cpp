@@ -1,8 +1,14 @@
 /* Copyright (C) Teemu Suutari */
 
+#include <algorithm>
+#include <vector>
+
 #include "CRMDecompressor.hpp"
 #include "HuffmanDecoder.hpp"
 #include "DLTADecode.hpp"
+#include "BackwardBitReader.hpp"
+#include "LZCopy.hpp"
+#include "Span.hpp"
 
 bool CRMDecompressor::detectHeader(uint32_t hdr) noexcept
 {
@@ -24,6 +30,19 @@ bool CRMDecompressor::detectHeaderXPK(uint32_t hdr) noexcept
 	return hdr==FourCC('CRM2') || hdr==FourCC('CRMS');
 }
 
+bool CRMDecompressor::probe(const Buffer &packedData,bool exactSizeKnown) noexcept
+{
+	ConstSpan packed(packedData);
+	if (packed.size()<20) return false;
+	uint32_t rawSize=packed.readBE32Unchecked(6);
+	uint32_t packedSize=packed.readBE32Unchecked(10);
+	if (!rawSize || !packedSize ||
+		rawSize>getMaxRawSize() || packedSize>getMaxPackedSize() ||
+		packedSize+14>packed.size()) return false;
+	// bit count of the first word of the stream
+	return packed.readBE16Unchecked(packedSize+12)<=16;
+}
+
 std::unique_ptr<Decompressor> CRMDecompressor::create(const Buffer &packedData,bool exactSizeKnown,bool verify)
 {
 	return std::make_unique<CRMDecompressor>(packedData,0,verify);
@@ -98,42 +117,26 @@ void CRMDecompressor::decompressImpl(Buffer &rawData,bool verify)
 {
 	if (rawData.size()<_rawSize) throw Decompressor::DecompressionError();
 
-	const uint8_t *bufPtr=_packedData.data();
+	ConstSpan packed(_packedData);
 	size_t bufOffset=_packedSize+14-6;
 
 	// There are empty bits?!? at the start of the stream. take them out
-	uint32_t originalBitsContent=_packedData.readBE32(bufOffset);
-	uint16_t originalShift=_packedData.readBE16(bufOffset+4);
-	uint8_t bufBitsLength=originalShift+16;
-	uint32_t bufBitsContent=originalBitsContent>>(16-originalShift);
+	uint32_t originalBitsContent=packed.readBE32(bufOffset);
+	uint16_t originalShift=packed.readBE16(bufOffset+4);
+	if (originalShift>16) throw Decompressor::DecompressionError();
 
 	// streamreader
+	BackwardBitReader<false> bitReader(packed.data(),bufOffset,14);
+	bitReader.preload(originalBitsContent>>(16-originalShift),originalShift+16);
+
 	auto readBit=[&]()->uint8_t
 	{
-		if (!bufBitsLength)
-		{
-			if (bufOffset<=14) throw Decompressor::DecompressionError();
-			bufBitsContent=uint32_t(bufPtr[--bufOffset]);
-			bufBitsLength=8;
-		}
-		uint8_t ret=bufBitsContent&1;
-		bufBitsContent>>=1;
-		bufBitsLength--;
-		return ret;
+		return bitReader.readBit();
 	};
 
 	auto readBits=[&](uint32_t count)->uint32_t
 	{
-		while (bufBitsLength<count)
-		{
-			if (bufOffset<=14) throw Decompressor::DecompressionError();
-			bufBitsContent|=uint32_t(bufPtr[--bufOffset])<<bufBitsLength;
-			bufBitsLength+=8;
-		}
-		uint32_t ret=bufBitsContent&((1<<count)-1);
-		bufBitsContent>>=count;
-		bufBitsLength-=count;
-		return ret;
+		return bitReader.readBits(count);
 	};
 
 	uint8_t *dest=rawData.data();
@@ -141,37 +144,58 @@ void CRMDecompressor::decompressImpl(Buffer &rawData,bool verify)
 
 	if (_isLZH)
 	{
-		typedef HuffmanDecoder<uint32_t,0x200,0> CRMHuffmanDecoder;
+		// Flat lookup table indexed by the next maxDepth bits (first bit of the code is the lowest).
+		// Entry has the value and the code length, 0 for the invalid codes
+		struct HuffmanTable
+		{
+			std::vector<uint16_t>	entries;
+			uint32_t		maxDepth;
+		};
 
-		auto readHuffmanTable=[&](CRMHuffmanDecoder &dec,uint32_t codeLength)
+		auto readHuffmanTable=[&](HuffmanTable &table,uint32_t codeLength)
 		{
 			uint32_t maxDepth=readBits(4);
 			if (!maxDepth) throw Decompressor::DecompressionError();
-			uint32_t lengthTable[maxDepth];
+			uint32_t lengthTable[15];
 			for (uint32_t i=0;i<maxDepth;i++)
 				lengthTable[i]=readBits(std::min(i+1,codeLength));
+			table.entries.assign(size_t(1)<<maxDepth,0);
+			table.maxDepth=maxDepth;
 			uint32_t code=0;
 			for (uint32_t depth=1;depth<=maxDepth;depth++)
 			{
 				for (uint32_t i=0;i<lengthTable[depth-1];i++)
 				{
-						uint32_t value=readBits(codeLength);
-						dec.insert(HuffmanCode<uint32_t>{depth,code>>(maxDepth-depth),value});
-						code+=1<<(maxDepth-depth);
+					uint32_t value=readBits(codeLength);
+					// over-subscribed
+					if (code>=(1U<<maxDepth)) throw Decompressor::DecompressionError();
+					uint32_t prefix=code>>(maxDepth-depth),reversed=0;
+					for (uint32_t j=0;j<depth;j++)
+						reversed|=((prefix>>j)&1)<<(depth-j-1);
+					for (uint32_t j=reversed;j<(1U<<maxDepth);j+=1<<depth)
+						table.entries[j]=uint16_t((value<<4)|depth);
+					code+=1<<(maxDepth-depth);
 				}
 			}
 		};
 
+		auto huffmanDecode=[&](const HuffmanTable &table)->uint32_t
+		{
+			uint32_t entry=table.entries[bitReader.peekBits(table.maxDepth)];
+			if (!entry) throw Decompressor::DecompressionError();
+			readBits(entry&15);
+			return entry>>4;
+		};
 
+		HuffmanTable lengthTable,distanceTable;
 		do {
-			CRMHuffmanDecoder lengthDecoder,distanceDecoder;
-			readHuffmanTable(lengthDecoder,9);
-			readHuffmanTable(distanceDecoder,4);
+			readHuffmanTable(lengthTable,9);
+			readHuffmanTable(distanceTable,4);
 
 			uint32_t items=readBits(16)+1;
 			for (uint32_t i=0;i<items;i++)
 			{
-				uint32_t count=lengthDecoder.decode(readBit);
+				uint32_t count=huffmanDecode(lengthTable);
 				if (count&0x100)
 				{
 					// this is literal, not count
@@ -180,7 +204,7 @@ void CRMDecompressor::decompressImpl(Buffer &rawData,bool verify)
 				} else {
 					count+=3;
 
-					uint32_t distanceBits=distanceDecoder.decode(readBit);
+					uint32_t distanceBits=huffmanDecode(distanceTable);
 					uint32_t distance;
 					if (!distanceBits)
 					{
@@ -189,8 +213,8 @@ void CRMDecompressor::decompressImpl(Buffer &rawData,bool verify)
 						distance=(readBits(distanceBits)|(1<<distanceBits))+1;
 					}
 					if (destOffset<size_t(count) || destOffset+distance>_rawSize) throw Decompressor::DecompressionError();
-					distance+=destOffset;
-					for (uint32_t i=0;i<count;i++) dest[--destOffset]=dest[--distance];
+					LZCopyBackward(dest+destOffset,distance,count);
+					destOffset-=count;
 				}
 			}
 		} while (readBit());
@@ -242,8 +266,8 @@ void CRMDecompressor::decompressImpl(Buffer &rawData,bool verify)
 					uint32_t distance=readBits(distanceBits[distanceIndex])+distanceAdditions[distanceIndex];
 
 					if (!distance || destOffset<count || destOffset+distance>_rawSize) throw Decompressor::DecompressionError();
-					distance+=destOffset;
-					for (uint32_t i=0;i<count;i++) dest[--destOffset]=dest[--distance];
+					LZCopyBackward(dest+destOffset,distance,count);
+					destOffset-=count;
 				}
 			}
 		}
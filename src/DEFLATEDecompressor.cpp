@@ -5,6 +5,8 @@
 
 #include "DEFLATEDecompressor.hpp"
 #include "HuffmanDecoder.hpp"
+#include "LZCopy.hpp"
+#include "Span.hpp"
 #include <CRC32.hpp>
 
 static uint32_t Adler32(const Buffer &buffer,size_t offset,size_t len)
@@ -33,6 +35,32 @@ bool DEFLATEDecompressor::detectHeaderXPK(uint32_t hdr) noexcept
 	return (hdr==FourCC('GZIP'));
 }
 
+bool DEFLATEDecompressor::probe(const Buffer &packedData,bool exactSizeKnown) noexcept
+{
+	// same header parsing as in the constructor
+	ConstSpan packed(packedData);
+	size_t packedSize=packed.size();
+	if (packedSize<18 || packed.read8Unchecked(2)!=8) return false;
+	uint8_t flags=packed.read8Unchecked(3);
+	if (flags&0xe0) return false;
+
+	size_t currentOffset=10;
+	if (flags&4) currentOffset+=size_t(packed.readLE16Unchecked(currentOffset))+2;
+	for (uint32_t i=0;i<2;i++)
+	{
+		if (!(flags&(8<<i))) continue;
+		do {
+			if (currentOffset>=packedSize) return false;
+		} while (packed.read8Unchecked(currentOffset++));
+	}
+	if (flags&2) currentOffset+=2;
+	if (currentOffset+8>packedSize) return false;
+	if (exactSizeKnown && !packed.readLE32Unchecked(packedSize-4)) return false;
+
+	// first block can not have the reserved type
+	return ((packed.read8Unchecked(currentOffset)>>1)&3)!=3;
+}
+
 std::unique_ptr<Decompressor> DEFLATEDecompressor::create(const Buffer &packedData,bool exactSizeKnown,bool verify)
 {
 	return std::make_unique<DEFLATEDecompressor>(packedData,exactSizeKnown,verify);
@@ -181,12 +209,14 @@ size_t DEFLATEDecompressor::getRawSize() const noexcept
 	return _rawSize;
 }
 
-void DEFLATEDecompressor::decompressImpl(Buffer &rawData,bool verify)
+// When measuring, nothing is written to dest (it can be null). Returns the end offset of the deflate stream
+template<bool measure>
+size_t DEFLATEDecompressor::decodeStream(uint8_t *dest,size_t rawSize)
 {
-	size_t packedSize=_packedSize?_packedSize:_packedData.size();
-	size_t rawSize=_rawSize?_rawSize:rawData.size();
+	ConstSpan packed(_packedData);
+	size_t packedSize=_packedSize?_packedSize:packed.size();
 
-	const uint8_t *bufPtr=_packedData.data();
+	const uint8_t *bufPtr=packed.data();
 	size_t bufOffset=_packedOffset;
 
 	uint8_t bufBitsLength=0;
@@ -222,7 +252,6 @@ void DEFLATEDecompressor::decompressImpl(Buffer &rawData,bool verify)
 		return ret;
 	};
 
-	uint8_t *dest=rawData.data();
 	size_t destOffset=0;
 
 	bool final;
@@ -233,12 +262,12 @@ void DEFLATEDecompressor::decompressImpl(Buffer &rawData,bool verify)
 		{
 			bufBitsLength=0;
 			bufBitsContent=0;
-			uint16_t len=_packedData.readLE16(bufOffset);
-			uint16_t nlen=_packedData.readLE16(bufOffset+2);
+			uint16_t len=packed.readLE16(bufOffset);
+			uint16_t nlen=packed.readLE16(bufOffset+2);
 			bufOffset+=4;
 			if (len!=(nlen^0xffffU)) throw DecompressionError();
 			if (bufOffset+len>packedSize || destOffset+len>rawSize) throw DecompressionError();
-			::memcpy(&dest[destOffset],&bufPtr[bufOffset],len);
+			if (!measure) ::memcpy(&dest[destOffset],&bufPtr[bufOffset],len);
 			bufOffset+=len;
 			destOffset+=len;
 		} else if (blockType==1 || blockType==2) {
@@ -330,7 +359,8 @@ void DEFLATEDecompressor::decompressImpl(Buffer &rawData,bool verify)
 				int32_t code=llDecoder.decode(readBit);
 				if (code<256) {
 					if (destOffset>=rawSize) throw DecompressionError();
-					dest[destOffset++]=code;
+					if (!measure) dest[destOffset]=code;
+					destOffset++;
 				} else if (code==256) {
 					break;
 				} else {
@@ -363,8 +393,8 @@ void DEFLATEDecompressor::decompressImpl(Buffer &rawData,bool verify)
 					uint32_t distance=readBits(distanceBits[distCode])+distanceAdditions[distCode];
 
 					if (distance>destOffset || destOffset+count>rawSize) throw DecompressionError();
-					for (uint32_t i=0;i<count;i++,destOffset++)
-						dest[destOffset]=dest[destOffset-distance];
+					if (!measure) LZCopyForward(dest+destOffset,distance,count);
+					destOffset+=count;
 				}
 			}
 		} else {
@@ -388,19 +418,37 @@ void DEFLATEDecompressor::decompressImpl(Buffer &rawData,bool verify)
 	}
 	if (_rawSize!=destOffset) throw DecompressionError();
 
+	return bufOffset;
+}
+
+void DEFLATEDecompressor::decompressImpl(Buffer &rawData,bool verify)
+{
+	size_t bufOffset=decodeStream<false>(rawData.data(),_rawSize?_rawSize:rawData.size());
+
 	if (verify)
 	{
+		ConstSpan packed(_packedData);
 		if (_type==Type::GZIP)
 		{
-			uint32_t crc=_packedData.readLE32(bufOffset);
+			uint32_t crc=packed.readLE32(bufOffset);
 			if (CRC32(rawData,0,_rawSize,0)!=crc) throw VerificationError();
 		} else if (_type==Type::ZLib) {
-			uint32_t adler=_packedData.readBE32(bufOffset);
+			uint32_t adler=packed.readBE32(bufOffset);
 			if (Adler32(rawData,0,_rawSize)!=adler) throw VerificationError();
 		}
 	}
 }
 
+bool DEFLATEDecompressor::measureImpl()
+{
+	size_t bufOffset=decodeStream<true>(nullptr,_rawSize?_rawSize:getMaxRawSize());
+
+	// checksums need the data, but gzip has the raw size in the trailer as well.
+	// Empty streams are not accepted, like when the exact size is known
+	if (_type==Type::GZIP && (!_rawSize || ConstSpan(_packedData).readLE32(bufOffset+4)!=uint32_t(_rawSize))) throw DecompressionError();
+	return true;
+}
+
 void DEFLATEDecompressor::decompressImpl(Buffer &rawData,const Buffer &previousData,bool verify)
 {
 	decompressImpl(rawData,verify);
@@ -22,8 +22,10 @@ public:
 
 	virtual void decompressImpl(Buffer &rawData,bool verify) override final;
 	virtual void decompressImpl(Buffer &rawData,const Buffer &previousData,bool verify) override final;
+	virtual bool measureImpl() override final;
 
 	static bool detectHeader(uint32_t hdr) noexcept;
+	static bool probe(const Buffer &packedData,bool exactSizeKnown) noexcept;
 	static bool detectHeaderXPK(uint32_t hdr) noexcept;
 
 	static std::unique_ptr<Decompressor> create(const Buffer &packedData,bool exactSizeKnown,bool verify);
@@ -31,6 +33,8 @@ public:
 
 private:
 	bool detectZLib();
+	template<bool measure>
+	size_t decodeStream(uint8_t *dest,size_t rawSize);
 
 	enum class Type
 	{
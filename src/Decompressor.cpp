@@ -1,8 +1,9 @@
 /* Copyright (C) Teemu Suutari */
 
 #include "Decompressor.hpp"
+#include "Span.hpp"
 
-std::vector<std::pair<bool(*)(uint32_t),std::unique_ptr<Decompressor>(*)(const Buffer&,bool,bool)>> *Decompressor::_decompressors=nullptr;
+std::vector<Decompressor::Entry> *Decompressor::_decompressors=nullptr;
 
 Decompressor::~Decompressor()
 {
@@ -16,7 +17,7 @@ std::unique_ptr<Decompressor> Decompressor::create(const Buffer &packedData,bool
 		uint32_t hdr=packedData.readBE32(0);
 		for (auto &it : *_decompressors)
 		{
-			if (it.first(hdr)) return it.second(packedData,exactSizeKnown,verify);
+			if (it.detect(hdr)) return it.create(packedData,exactSizeKnown,verify);
 		}
 		throw InvalidFormatError();
 	} catch (const Buffer::Error&) {
@@ -30,18 +31,28 @@ bool Decompressor::detect(const Buffer &packedData) noexcept
 	{
 		uint32_t hdr=packedData.readBE32(0);
 		for (auto &it : *_decompressors)
-			if (it.first(hdr)) return true;
+			if (it.detect(hdr)) return true;
 		return false;
 	} catch (const Buffer::Error&) {
 		return false;
 	}
 }
 
-void Decompressor::registerDecompressor(bool(*detect)(uint32_t),std::unique_ptr<Decompressor>(*create)(const Buffer&,bool,bool))
+bool Decompressor::probe(const Buffer &packedData,bool exactSizeKnown) noexcept
 {
-	static std::vector<std::pair<bool(*)(uint32_t),std::unique_ptr<Decompressor>(*)(const Buffer&,bool,bool)>> _list;
+	if (packedData.size()<4) return false;
+	uint32_t hdr=loadBE32(packedData.data());
+	// first match is the one create would use
+	for (auto &it : *_decompressors)
+		if (it.detect(hdr)) return it.probe(packedData,exactSizeKnown);
+	return false;
+}
+
+void Decompressor::registerDecompressor(bool(*detect)(uint32_t),bool(*probe)(const Buffer&,bool),std::unique_ptr<Decompressor>(*create)(const Buffer&,bool,bool))
+{
+	static std::vector<Entry> _list;
 	if (!_decompressors) _decompressors=&_list;
-	_decompressors->push_back(std::make_pair(detect,create));
+	_decompressors->push_back(Entry{detect,probe,create});
 }
 
 void Decompressor::decompress(Buffer &rawData,bool verify)
@@ -55,3 +66,19 @@ void Decompressor::decompress(Buffer &rawData,bool verify)
 		throw DecompressionError();
 	}
 }
+
+bool Decompressor::measure()
+{
+	// same as above
+	try
+	{
+		return measureImpl();
+	} catch (const Buffer::Error&) {
+		throw DecompressionError();
+	}
+}
+
+bool Decompressor::measureImpl()
+{
+	return false;
+}
@@ -8,6 +8,7 @@
 
 #include <string>
 #include <memory>
+#include <vector>
 
 #include <Common.hpp>
 #include <Buffer.hpp>
@@ -62,6 +63,15 @@ public:
 	// can throw VerificationError if verify enabled and checksum does not match
 	void decompress(Buffer &rawData,bool verify);
 
+	// Walks through the stream without producing any output, in order to find out the packed size
+	// for those formats where it is 0 before decompression. Raw size is updated too, if it can be
+	// determined from the stream alone.
+	// Stream structure is validated as far as possible without data i.e. checksums of the raw data
+	// are not verified.
+	// returns false if the format does not support measuring, decompress is needed instead.
+	// can throw DecompressionError if stream cant be unpacked
+	bool measure();
+
 	// the functions are there to protect against "accidental" large files when parsing headers
 	// a.k.a. 16M should be enough for everybody (sizes do not have to accurate i.e.
 	// compressors can exclude header content for simplification)
@@ -83,6 +93,12 @@ public:
 	// This does not guarantee the data is decompressable though, only signature is read
 	static bool detect(const Buffer &packedData) noexcept;
 
+	// Deeper, but still cheap, check than detect: the header and the start of the stream are checked
+	// against the invariants of the format (sizes, modes, block headers). Checksums are not calculated.
+	// If this returns false, verifying create with the same exactSizeKnown or the decompression would fail.
+	// Meant for filtering out false positives before trying to decompress.
+	static bool probe(const Buffer &packedData,bool exactSizeKnown) noexcept;
+
 	// Registering new decompressors, not really part of public API
 	template<class T>
 	class Registry
@@ -90,7 +106,7 @@ public:
 	public:
 		Registry()
 		{
-			Decompressor::registerDecompressor(T::detectHeader,T::create);
+			Decompressor::registerDecompressor(T::detectHeader,T::probe,T::create);
 		}
 
 		~Registry()
@@ -101,11 +117,19 @@ public:
 
 protected:
 	virtual void decompressImpl(Buffer &rawData,bool verify)=0;
+	virtual bool measureImpl();
 
 private:
-	static void registerDecompressor(bool(*detect)(uint32_t),std::unique_ptr<Decompressor>(*create)(const Buffer&,bool,bool));
+	struct Entry
+	{
+		bool(*detect)(uint32_t);
+		bool(*probe)(const Buffer&,bool);
+		std::unique_ptr<Decompressor>(*create)(const Buffer&,bool,bool);
+	};
+
+	static void registerDecompressor(bool(*detect)(uint32_t),bool(*probe)(const Buffer&,bool),std::unique_ptr<Decompressor>(*create)(const Buffer&,bool,bool));
 
-	static std::vector<std::pair<bool(*)(uint32_t),std::unique_ptr<Decompressor>(*)(const Buffer&,bool,bool)>> *_decompressors;
+	static std::vector<Entry> *_decompressors;
 };
 
 
@@ -0,0 +1,178 @@
+/* Copyright (C) Teemu Suutari */
+
+#include <memory>
+#include <set>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <algorithm>
+
+#include <stdio.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "DirectoryWalker.hpp"
+
+// Open directory, kept open while its subdirectories are waiting to be opened relative to it
+class DirectoryHandle
+{
+public:
+	DirectoryHandle(DIR *dir) noexcept :
+		_dir(dir)
+	{
+		// nothing needed
+	}
+
+	DirectoryHandle(const DirectoryHandle&)=delete;
+	DirectoryHandle& operator=(const DirectoryHandle&)=delete;
+
+	~DirectoryHandle()
+	{
+		::closedir(_dir);
+	}
+
+	DIR *get() const noexcept { return _dir; }
+	int fd() const noexcept { return ::dirfd(_dir); }
+
+private:
+	DIR	*_dir;
+};
+
+struct Directory
+{
+	std::string				name;
+	size_t					baseOffset;	// of the last component in name, 0 for the root
+	std::shared_ptr<DirectoryHandle>	parent;		// nullptr for the root
+	bool					follow;		// reached through a symbolic link
+};
+
+// Reads single directory. Returns false if the directory has been visited already (or can't be read).
+// Subdirectories are opened by their name relative to the parent, not by the full path. Thus a renamed
+// or replaced directory higher up can not redirect the walk, and a directory replaced by a link
+// is not followed unless it was a link when the parent was read
+template<typename F>
+static bool readDirectory(const Directory &directory,F visit,const std::function<bool(const std::string&)> &wanted,
+	std::vector<Directory> &subDirs,std::vector<DirectoryWalker::File> &files)
+{
+	int fd=::openat(directory.parent?directory.parent->fd():AT_FDCWD,directory.name.c_str()+directory.baseOffset,
+		O_RDONLY|O_DIRECTORY|O_CLOEXEC|(directory.follow?0:O_NOFOLLOW));
+	struct stat dirSt;
+	if (fd<0 || ::fstat(fd,&dirSt)<0)
+	{
+		if (fd>=0) ::close(fd);
+		fprintf(stderr,"Could not process directory %s\n",directory.name.c_str());
+		return false;
+	}
+	if (!visit(dirSt))
+	{
+		::close(fd);
+		return false;
+	}
+	// takes the ownership of fd
+	DIR *dir=::fdopendir(fd);
+	if (!dir)
+	{
+		::close(fd);
+		fprintf(stderr,"Could not process directory %s\n",directory.name.c_str());
+		return false;
+	}
+	auto handle{std::make_shared<DirectoryHandle>(dir)};
+	size_t baseOffset=directory.name.size()+1;
+	while (struct dirent *de=::readdir(dir))
+	{
+		const char *subName=de->d_name;
+		if (subName[0]=='.' && (!subName[1] || (subName[1]=='.' && !subName[2]))) continue;
+		std::string name=directory.name+"/"+subName;
+		bool isWanted=false;
+		switch (de->d_type)
+		{
+			case DT_DIR:
+			subDirs.push_back(Directory{std::move(name),baseOffset,handle,false});
+			continue;
+
+			case DT_REG:
+			// no need to stat the files that are not wanted
+			if (!wanted(name)) continue;
+			isWanted=true;
+			break;
+
+			case DT_LNK:
+			case DT_UNKNOWN:
+			break;
+
+			default:
+			// devices, pipes, sockets
+			continue;
+		}
+		// size and time are needed for the regular files, links need to be resolved
+		struct stat st;
+		if (::fstatat(fd,subName,&st,0)<0) continue;
+		if (S_ISDIR(st.st_mode))
+		{
+			// symbolic links are followed, without the type from readdir it is not known whether this is one
+			subDirs.push_back(Directory{std::move(name),baseOffset,handle,true});
+		} else if (S_ISREG(st.st_mode) && (isWanted || wanted(name))) {
+			files.push_back(DirectoryWalker::File{std::move(name),st});
+		}
+	}
+	return true;
+}
+
+std::vector<DirectoryWalker::File> DirectoryWalker::walk(const std::string &root,uint32_t threads,const std::function<bool(const std::string&)> &wanted)
+{
+	std::mutex mutex;
+	std::condition_variable condition;
+	// depth first, the open parents are bounded by the depth of the tree
+	std::vector<Directory> stack{Directory{root,0,nullptr,true}};
+	uint32_t active=0;
+	std::set<std::pair<dev_t,ino_t>> visited;
+	std::vector<File> ret;
+
+	auto visit=[&](const struct stat &st)->bool
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return visited.insert(std::make_pair(st.st_dev,st.st_ino)).second;
+	};
+
+	auto worker=[&]()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		for (;;)
+		{
+			// done when there is nothing queued and nobody can add more
+			condition.wait(lock,[&]() { return !stack.empty() || !active; });
+			if (stack.empty()) break;
+			Directory directory=std::move(stack.back());
+			stack.pop_back();
+			active++;
+			lock.unlock();
+
+			std::vector<Directory> subDirs;
+			std::vector<File> files;
+			readDirectory(directory,visit,wanted,subDirs,files);
+			// the parent is closed here when it has no subdirectories left
+			directory.parent.reset();
+
+			lock.lock();
+			for (auto &it : subDirs) stack.push_back(std::move(it));
+			for (auto &it : files) ret.push_back(std::move(it));
+			active--;
+			condition.notify_all();
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for (uint32_t i=1;i<threads;i++)
+		workers.emplace_back(worker);
+	worker();
+	for (auto &it : workers) it.join();
+
+	std::sort(ret.begin(),ret.end(),[](const File &a,const File &b)
+	{
+		if (a.st.st_dev!=b.st.st_dev) return a.st.st_dev<b.st.st_dev;
+		if (a.st.st_ino!=b.st.st_ino) return a.st.st_ino<b.st.st_ino;
+		return a.name<b.name;
+	});
+	return ret;
+}
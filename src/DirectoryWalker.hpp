@@ -0,0 +1,36 @@
+/* Copyright (C) Teemu Suutari */
+
+#ifndef DIRECTORYWALKER_HPP
+#define DIRECTORYWALKER_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <sys/stat.h>
+
+#include <string>
+#include <vector>
+#include <functional>
+
+// Finds the regular files in a directory tree for the command line tool.
+// Entries are examined and subdirectories opened relative to the directory descriptor (fstatat, openat),
+// and the type from readdir is used to skip the stat for directories and special files. Symbolic links
+// are followed, every directory is visited only once, which protects against symbolic link loops.
+// Directories are processed depth first, in parallel when there are multiple threads.
+class DirectoryWalker
+{
+public:
+	struct File
+	{
+		std::string	name;
+		struct stat	st;
+	};
+
+	DirectoryWalker()=delete;
+
+	// Only the files accepted by wanted (by their path) are returned.
+	// Files are sorted by device and inode, for the locality when reading them
+	static std::vector<File> walk(const std::string &root,uint32_t threads,const std::function<bool(const std::string&)> &wanted);
+};
+
+#endif
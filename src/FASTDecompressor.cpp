@@ -1,6 +1,8 @@
 /* Copyright (C) Teemu Suutari */
 
 #include "FASTDecompressor.hpp"
+#include "FlagLZDecoder.hpp"
+#include "Span.hpp"
 
 bool FASTDecompressor::detectHeaderXPK(uint32_t hdr) noexcept
 {
@@ -30,66 +32,34 @@ const std::string &FASTDecompressor::getSubName() const noexcept
 	return name;
 }
 
-void FASTDecompressor::decompressImpl(Buffer &rawData,const Buffer &previousData,bool verify)
+// control words and the matches are read from the end of the stream, literals from the start
+struct FASTPolicy
 {
-	// Stream reading
-	size_t packedSize=_packedData.size();
-	const uint8_t *bufPtr=_packedData.data();
-
-	size_t bufOffsetReverse=packedSize;
-	uint16_t bufBitsContent=0;
-	uint8_t bufBitsLength=0;
-
-	size_t bufOffset=0;
-
-	auto readBit=[&]()->uint8_t
-	{
-		if (!bufBitsLength)
-		{
-			if (bufOffsetReverse<bufOffset+2) throw Decompressor::DecompressionError();
-			bufBitsContent=uint16_t(bufPtr[--bufOffsetReverse]);
-			bufBitsContent|=uint16_t(bufPtr[--bufOffsetReverse])<<8;
-			bufBitsLength=16;
-		}
-		uint8_t ret=bufBitsContent>>15;
-		bufBitsContent<<=1;
-		bufBitsLength--;
-		return ret;
-	};
-
-	auto readByte=[&]()->uint8_t
-	{
-		if (bufOffset>=bufOffsetReverse) throw Decompressor::DecompressionError();
-		return bufPtr[bufOffset++];
-	};
+	static constexpr uint32_t wordBits=16;
+	static constexpr uint32_t tokenBits=1;
 
-	auto readShort=[&]()->uint16_t
+	static uint32_t readWord(FlagLZStream &stream)
 	{
-		if (bufOffsetReverse<bufOffset+2) throw Decompressor::DecompressionError();
-		uint16_t ret=uint16_t(bufPtr[--bufOffsetReverse]);
-		ret|=uint16_t(bufPtr[--bufOffsetReverse])<<8;
-		return ret;
-	};
-
-	uint8_t *dest=rawData.data();
-	size_t destOffset=0;
-	size_t rawSize=rawData.size();
+		if (stream.end<stream.offset+2) throw Decompressor::DecompressionError();
+		stream.end-=2;
+		return loadBE16(stream.ptr+stream.end);
+	}
 
-	while (destOffset!=rawSize)
+	static void decodeToken(FlagLZStream &stream,uint32_t token)
 	{
-		if (!readBit())
-		{
-			if (destOffset<rawSize)
-				dest[destOffset++]=readByte();
-		} else {
-			uint16_t ld=readShort();
-			uint32_t count=18-(ld&0xf);
-			uint32_t distance=ld>>4;
-			if (!distance || size_t(distance)>destOffset) throw Decompressor::DecompressionError();
-			for (uint32_t i=0;i<count&&destOffset<rawSize;i++,destOffset++)
-				dest[destOffset]=dest[destOffset-distance];
-		}
+		uint32_t ld=readWord(stream);
+		uint32_t count=18-(ld&0xf);
+		uint32_t distance=ld>>4;
+		if (!distance || size_t(distance)>stream.destOffset) throw Decompressor::DecompressionError();
+		if (stream.destOffset+count>stream.rawSize) count=uint32_t(stream.rawSize-stream.destOffset);
+		stream.copy(distance,count);
 	}
+};
+
+void FASTDecompressor::decompressImpl(Buffer &rawData,const Buffer &previousData,bool verify)
+{
+	FlagLZStream stream{_packedData.data(),0,_packedData.size(),rawData.data(),0,rawData.size()};
+	FlagLZDecode<FASTPolicy>(stream);
 }
 
 XPKDecompressor::Registry<FASTDecompressor> FASTDecompressor::_XPKregistration;
@@ -0,0 +1,48 @@
+/* Copyright (C) Teemu Suutari */
+
+#include <stdio.h>
+
+#include <fstream>
+
+#include "FileIO.hpp"
+#include "VectorBuffer.hpp"
+
+std::unique_ptr<Buffer> readFile(const std::string &fileName)
+{
+
+	std::unique_ptr<Buffer> ret=std::make_unique<VectorBuffer>();
+	std::ifstream file(fileName.c_str(),std::ios::in|std::ios::binary);
+	bool success=false;
+	if (file.is_open())
+	{
+		file.seekg(0,std::ios::end);
+		size_t length=size_t(file.tellg());
+		file.seekg(0,std::ios::beg);
+		ret->resize(length);
+		file.read(reinterpret_cast<char*>(ret->data()),length);
+		success=bool(file);
+		if (!success) ret->resize(0);
+		file.close();
+	}
+	if (!success)
+	{
+		fprintf(stderr,"Could not read file %s\n",fileName.c_str());
+	}
+	return ret;
+}
+
+bool writeFile(const std::string &fileName,const Buffer &content)
+{
+	bool ret=false;
+	std::ofstream file(fileName.c_str(),std::ios::out|std::ios::binary|std::ios::trunc);
+	if (file.is_open()) {
+		file.write(reinterpret_cast<const char*>(content.data()),content.size());
+		ret=bool(file);
+		file.close();
+	}
+	if (!ret)
+	{
+		fprintf(stderr,"Could not write file %s\n",fileName.c_str());
+	}
+	return ret;
+}
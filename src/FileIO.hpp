@@ -0,0 +1,16 @@
+/* Copyright (C) Teemu Suutari */
+
+#ifndef FILEIO_HPP
+#define FILEIO_HPP
+
+#include <string>
+#include <memory>
+
+#include "Buffer.hpp"
+
+// Whole file reads and writes for the command line tool. Failures are reported to stderr,
+// a failed read returns an empty buffer
+std::unique_ptr<Buffer> readFile(const std::string &fileName);
+bool writeFile(const std::string &fileName,const Buffer &content);
+
+#endif
@@ -0,0 +1,100 @@
+/* Copyright (C) Teemu Suutari */
+
+#ifndef FLAGLZDECODER_HPP
+#define FLAGLZDECODER_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+// For exception
+#include "Decompressor.hpp"
+#include "LZCopy.hpp"
+
+// Decoding loop shared by the byte oriented LZ formats, where 1 or 2 bit tokens in 8/16/32-bit control
+// words select between the literals and the matches (ACCA, FAST, LZW2, LZW4, LZW5, RDCN, TDCS, TPWM).
+// Token 0 is a literal in all of them, other tokens are given to the policy:
+//
+// struct Policy
+// {
+// 	static constexpr uint32_t wordBits;			// 8, 16 or 32
+// 	static constexpr uint32_t tokenBits;			// 1 or 2
+// 	static uint32_t readWord(FlagLZStream &stream);		// first token in the highest bits
+// 	static void decodeToken(FlagLZStream &stream,uint32_t token);
+// };
+//
+// The control word is read when its first token is needed. The loop is the same as the per-format
+// loops were, everything is inlined into it and there are no extra checks per token
+
+// when measuring, nothing is written and dest is not used
+template<bool measure>
+struct BasicFlagLZStream
+{
+	const uint8_t	*ptr;
+	size_t		offset;		// next data byte
+	size_t		end;		// end of the data bytes
+	uint8_t		*dest;
+	size_t		destOffset;
+	size_t		rawSize;
+
+	uint8_t readByte()
+	{
+		if (offset>=end) throw Decompressor::DecompressionError();
+		return ptr[offset++];
+	}
+
+	void literal()
+	{
+		uint8_t value=readByte();
+		if (!measure) dest[destOffset]=value;
+		destOffset++;
+	}
+
+	// distance and count are checked by the caller
+	void copy(uint32_t distance,uint32_t count) noexcept
+	{
+		if (!measure) LZCopyForward(dest+destOffset,distance,count);
+		destOffset+=count;
+	}
+
+	// short runs, cheaper than memset
+	void fill(uint8_t value,uint32_t count) noexcept
+	{
+		if (!measure)
+		{
+			uint8_t *ptr=dest+destOffset;
+			for (uint32_t i=0;i<count;i++) ptr[i]=value;
+		}
+		destOffset+=count;
+	}
+};
+
+using FlagLZStream=BasicFlagLZStream<false>;
+
+template<typename Policy,bool measure>
+void FlagLZDecode(BasicFlagLZStream<measure> &streamState)
+{
+	constexpr uint32_t tokenBits=Policy::tokenBits;
+	constexpr uint32_t wordTokens=Policy::wordBits/tokenBits;
+
+	// local copy, the output writes can not alias the caller's stream
+	BasicFlagLZStream<measure> stream=streamState;
+	uint32_t word=0;
+	uint32_t tokens=0;
+	while (stream.destOffset!=stream.rawSize)
+	{
+		if (!tokens)
+		{
+			// tokens from the top
+			word=Policy::readWord(stream)<<(32-Policy::wordBits);
+			tokens=wordTokens;
+		}
+		uint32_t token=word>>(32-tokenBits);
+		word<<=tokenBits;
+		tokens--;
+		if (!token) stream.literal();
+			else Policy::decodeToken(stream,token);
+	}
+	streamState=stream;
+}
+
+#endif
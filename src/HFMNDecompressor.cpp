@@ -1,7 +1,7 @@
 /* Copyright (C) Teemu Suutari */
 
 #include "HFMNDecompressor.hpp"
-#include "HuffmanDecoder.hpp"
+#include "ByteHuffmanDecoder.hpp"
 
 bool HFMNDecompressor::detectHeaderXPK(uint32_t hdr) noexcept
 {
@@ -66,10 +66,7 @@ void HFMNDecompressor::decompressImpl(Buffer &rawData,const Buffer &previousData
 		return ret;
 	};
 
-	uint8_t *dest=rawData.data();
-	size_t destOffset=0;
-
-	HuffmanDecoder<uint32_t,256,0> decoder;
+	ByteHuffmanDecoder decoder;
 	uint32_t code=1;
 	uint32_t codeBits=1;
 	for (;;)
@@ -93,12 +90,7 @@ void HFMNDecompressor::decompressImpl(Buffer &rawData,const Buffer &previousData
 	}
 	if (bufOffset+2>_headerSize) throw Decompressor::DecompressionError();
 
-	bufOffset=_headerSize;
-	bufBitsContent=0;
-	bufBitsLength=0;
-
-	while (destOffset!=_rawSize)
-		dest[destOffset++]=decoder.decode(readBit);
+	decoder.decode<false>(rawData.data(),_rawSize,bufPtr,_headerSize,packedSize,0,0);
 }
 
 XPKDecompressor::Registry<HFMNDecompressor> HFMNDecompressor::_XPKregistration;
@@ -1,7 +1,7 @@
 /* Copyright (C) Teemu Suutari */
 
 #include "HUFFDecompressor.hpp"
-#include "HuffmanDecoder.hpp"
+#include "ByteHuffmanDecoder.hpp"
 
 bool HUFFDecompressor::detectHeaderXPK(uint32_t hdr) noexcept
 {
@@ -45,34 +45,13 @@ void HUFFDecompressor::decompressImpl(Buffer &rawData,const Buffer &previousData
 	size_t packedSize=_packedData.size();
 	size_t bufOffset=6;
 
-	uint8_t bufBitsContent=0;
-	uint8_t bufBitsLength=0;
-
-	auto readBit=[&]()->uint8_t
-	{
-		if (!bufBitsLength)
-		{
-			if (bufOffset>=packedSize) throw Decompressor::DecompressionError();
-			bufBitsContent=bufPtr[bufOffset++];
-			bufBitsLength=8;
-		}
-		uint8_t ret=bufBitsContent>>7;
-		bufBitsContent<<=1;
-		bufBitsLength--;
-		return ret;
-	};
-
 	auto readByte=[&]()->uint8_t
 	{
 		if (bufOffset>=packedSize) throw Decompressor::DecompressionError();
 		return bufPtr[bufOffset++];
 	};
 
-	uint8_t *dest=rawData.data();
-	size_t destOffset=0;
-	size_t rawSize=rawData.size();
-
-	HuffmanDecoder<uint32_t,256,0> decoder;
+	ByteHuffmanDecoder decoder;
 	for (uint32_t i=0;i<256;i++)
 	{
 		uint8_t codeBits=readByte()+1;
@@ -89,8 +68,7 @@ void HUFFDecompressor::decompressImpl(Buffer &rawData,const Buffer &previousData
 		decoder.insert(HuffmanCode<uint32_t>{codeBits,code,i});
 	}
 
-	while (destOffset!=rawSize)
-		dest[destOffset++]=decoder.decode(readBit);
+	decoder.decode<false>(rawData.data(),rawData.size(),bufPtr,bufOffset,packedSize,0,0);
 }
 
 XPKDecompressor::Registry<HUFFDecompressor> HUFFDecompressor::_XPKregistration;
@@ -1,6 +1,7 @@
 /* Copyright (C) Teemu Suutari */
 
 #include "ILZRDecompressor.hpp"
+#include "LZCopy.hpp"
 
 bool ILZRDecompressor::detectHeaderXPK(uint32_t hdr) noexcept
 {
@@ -73,8 +74,8 @@ void ILZRDecompressor::decompressImpl(Buffer &rawData,const Buffer &previousData
 			uint32_t count=readBits(4)+3;
 
 			if (position>=destOffset || destOffset+count>_rawSize) throw Decompressor::DecompressionError();
-			for (uint32_t i=0;i<count;i++,destOffset++)
-				dest[destOffset]=dest[position+i];
+			LZCopyForward(dest+destOffset,destOffset-position,count);
+			destOffset+=count;
 		}
 	}
 }
@@ -1,7 +1,12 @@
 /* Copyright (C) Teemu Suutari */
 
+#include <algorithm>
+
 #include "IMPDecompressor.hpp"
 #include "HuffmanDecoder.hpp"
+#include "BackwardBitReader.hpp"
+#include "LZCopy.hpp"
+#include "Span.hpp"
 
 static bool readIMPHeader(uint32_t hdr,uint32_t &addition) noexcept
 {
@@ -35,6 +40,36 @@ static bool readIMPHeader(uint32_t hdr,uint32_t &addition) noexcept
 	}
 }
 
+// Sum of the 16-bit big endian words, length is even.
+// High and low bytes are summed separately, 4 words at a time in the 16-bit lanes of a 64-bit word.
+// A lane can take 256 bytes before overflowing
+static uint32_t sumBE16(const uint8_t *ptr,size_t length) noexcept
+{
+	uint32_t highSum=0,lowSum=0;
+	size_t i=0;
+	while (i+8<=length)
+	{
+		uint64_t high=0,low=0;
+		for (size_t end=std::min(length&~size_t(7),i+256*8);i<end;i+=8)
+		{
+			uint64_t tmp=loadLE64(ptr+i);
+			high+=tmp&0x00ff'00ff'00ff'00ffULL;
+			low+=(tmp>>8)&0x00ff'00ff'00ff'00ffULL;
+		}
+		for (uint32_t j=0;j<64;j+=16)
+		{
+			highSum+=uint32_t(high>>j)&0xffffU;
+			lowSum+=uint32_t(low>>j)&0xffffU;
+		}
+	}
+	for (;i<length;i+=2)
+	{
+		highSum+=ptr[i];
+		lowSum+=ptr[i+1];
+	}
+	return (highSum<<8)+lowSum;
+}
+
 bool IMPDecompressor::detectHeader(uint32_t hdr) noexcept
 {
 	uint32_t dummy;
@@ -46,6 +81,18 @@ bool IMPDecompressor::detectHeaderXPK(uint32_t hdr) noexcept
 	return hdr==FourCC('IMPL');
 }
 
+bool IMPDecompressor::probe(const Buffer &packedData,bool exactSizeKnown) noexcept
+{
+	ConstSpan packed(packedData);
+	if (packed.size()<0x32) return false;
+	uint32_t rawSize=packed.readBE32Unchecked(4);
+	uint32_t endOffset=packed.readBE32Unchecked(8);
+	if ((endOffset&1) || endOffset<0xc || !rawSize ||
+		rawSize>getMaxRawSize() || endOffset>getMaxPackedSize()) return false;
+	// constructor needs the checksum at the end, and does not allow anything after it
+	return size_t(endOffset)+0x32==packed.size();
+}
+
 std::unique_ptr<Decompressor> IMPDecompressor::create(const Buffer &packedData,bool exactSizeKnown,bool verify)
 {
 	return std::make_unique<IMPDecompressor>(packedData,verify);
@@ -72,14 +119,7 @@ IMPDecompressor::IMPDecompressor(const Buffer &packedData,bool verify) :
 	if (verify && checksumAddition)
 	{
 		// size is divisible by 2
-		uint32_t sum=checksumAddition;
-		for (uint32_t i=0;i<_endOffset+0x2e;i+=2)
-		{
-			// TODO: slow, optimize
-			uint16_t tmp=_packedData.readBE16(i);
-			sum+=uint32_t(tmp);
-		}
-		if (checksum!=sum) throw InvalidFormatError();
+		if (checksum!=checksumAddition+sumBE16(_packedData.data(),_endOffset+0x2e)) throw InvalidFormatError();
 	}
 }
 
@@ -126,89 +166,115 @@ void IMPDecompressor::decompressImpl(Buffer &rawData,bool verify)
 {
 	if (rawData.size()<_rawSize) throw DecompressionError();
 
-	uint8_t markerByte=_packedData.read8(_endOffset+16);
+	ConstSpan packed(_packedData);
+	uint8_t markerByte=packed.read8(_endOffset+16);
 
-	const uint8_t *bufPtr=_packedData.data();
 	size_t bufOffset=_endOffset;
 	if (!(markerByte&0x80)) bufOffset--;
 
-	uint8_t bufBitsContent=_packedData.read8(_endOffset+17);
-	uint8_t bufBitsLength=7;
+	uint8_t anchorByte=packed.read8(_endOffset+17);
+	uint32_t anchorBits=7;
 	// the anchor-bit does not seem always to be at the correct place
 	for (uint32_t i=0;i<7;i++)
-		if (bufBitsContent&(1<<i)) break;
-			else bufBitsLength--;
+		if (anchorByte&(1<<i)) break;
+			else anchorBits--;
 
-	// streamreader with funny ordering
-	auto sourceOffset=[&](size_t i)->size_t
-	{
-		if (i>=12)
-		{
-			return i;
-		} else {
-			if (i<4)
-			{
-				return i+_endOffset+8;
-			} else if (i<8) {
-				return i+_endOffset;
-			} else {
-				return i+_endOffset-8;
-			}
-		}
-	};
+	// streamreader with funny ordering: first 12 bytes of the stream are stored
+	// after the end as 3 longwords in reverse order
+	const uint8_t *bufPtr=packed.data();
+	uint8_t streamStart[12];
+	for (uint32_t i=0;i<12;i++)
+		streamStart[i]=bufPtr[_endOffset+8-(i&~3U)+(i&3U)];
 
-	auto readBit=[&]()->uint8_t
-	{
-		if (!bufBitsLength)
-		{
-			if (!bufOffset) throw DecompressionError();
-			bufBitsContent=bufPtr[sourceOffset(--bufOffset)];
-			bufBitsLength=8;
-		}
-		uint8_t ret=bufBitsContent>>7;
-		bufBitsContent<<=1;
-		bufBitsLength--;
-		return ret;
-	};
+	BackwardBitReader<true> bitReader(bufPtr,bufOffset,12);
+	if (bufOffset<=12) bitReader.setContinuation(streamStart,bufOffset);
+		else bitReader.setContinuation(streamStart,12);
+	bitReader.preload(anchorByte>>(8-anchorBits),anchorBits);
 
 	auto readBits=[&](uint32_t count)->uint32_t
 	{
-		uint32_t ret=0;
-		for (uint32_t i=0;i<count;i++) ret=(ret<<1)|uint32_t(readBit());
-		return ret;
+		return bitReader.readBits(count);
 	};
 
 	auto readByte=[&]()->uint8_t
 	{
-		if (!bufOffset) throw DecompressionError();
-		return bufPtr[sourceOffset(--bufOffset)];
+		return bitReader.readByte();
 	};
-	
 
 	// tables
 	uint16_t distanceValues[2][4];
 	for (uint32_t i=0;i<8;i++)
-		distanceValues[i>>2][i&3]=_packedData.readBE16(_endOffset+18+i*2);
+		distanceValues[i>>2][i&3]=packed.readBE16(_endOffset+18+i*2);
+	// longer distances than 24 bits do not fit into the maximum raw size anyway
 	uint8_t distanceBits[3][4];
 	for (uint32_t i=0;i<12;i++)
-		distanceBits[i>>2][i&3]=_packedData.read8(_endOffset+34+i);
+	{
+		distanceBits[i>>2][i&3]=packed.read8(_endOffset+34+i);
+		if (distanceBits[i>>2][i&3]>24) throw DecompressionError();
+	}
+
+	// length, distance & literal counts are all intertwined.
+	// The codes are fixed, they are looked up from flat tables (code length << 4 | value)
+	// built once from the definitions below
+	struct Tables
+	{
+		uint8_t	lld[32];
+		uint8_t	lld2[4];
+	};
+
+	static const Tables tables=[]()->Tables
+	{
+		HuffmanDecoder<uint8_t,0xffU,5> lldDecoder
+		{
+			HuffmanCode<uint8_t>{1,0b00000,0},
+			HuffmanCode<uint8_t>{2,0b00010,1},
+			HuffmanCode<uint8_t>{3,0b00110,2},
+			HuffmanCode<uint8_t>{4,0b01110,3},
+			HuffmanCode<uint8_t>{5,0b11110,4},
+			HuffmanCode<uint8_t>{5,0b11111,5}
+		};
+
+		HuffmanDecoder<uint8_t,0xffU,2> lldDecoder2
+		{
+			HuffmanCode<uint8_t>{1,0b00,0},
+			HuffmanCode<uint8_t>{2,0b10,1},
+			HuffmanCode<uint8_t>{2,0b11,2}
+		};
+
+		Tables ret;
+		for (uint32_t i=0;i<32;i++)
+		{
+			uint32_t pos=0;
+			uint8_t value=lldDecoder.decode([&]()->uint8_t
+			{
+				return (i>>(4-pos++))&1;
+			});
+			ret.lld[i]=(pos<<4)|value;
+		}
+		for (uint32_t i=0;i<4;i++)
+		{
+			uint32_t pos=0;
+			uint8_t value=lldDecoder2.decode([&]()->uint8_t
+			{
+				return (i>>(1-pos++))&1;
+			});
+			ret.lld2[i]=(pos<<4)|value;
+		}
+		return ret;
+	}();
 
-	// length, distance & literal counts are all intertwined
-	HuffmanDecoder<uint8_t,0xffU,5> lldDecoder
+	auto decodeLLD=[&]()->uint32_t
 	{
-		HuffmanCode<uint8_t>{1,0b00000,0},
-		HuffmanCode<uint8_t>{2,0b00010,1},
-		HuffmanCode<uint8_t>{3,0b00110,2},
-		HuffmanCode<uint8_t>{4,0b01110,3},
-		HuffmanCode<uint8_t>{5,0b11110,4},
-		HuffmanCode<uint8_t>{5,0b11111,5}
+		uint32_t entry=tables.lld[bitReader.peekBits(5)];
+		readBits(entry>>4);
+		return entry&15;
 	};
 
-	HuffmanDecoder<uint8_t,0xffU,2> lldDecoder2
+	auto decodeLLD2=[&]()->uint32_t
 	{
-		HuffmanCode<uint8_t>{1,0b00,0},
-		HuffmanCode<uint8_t>{2,0b10,1},
-		HuffmanCode<uint8_t>{2,0b11,2}
+		uint32_t entry=tables.lld2[bitReader.peekBits(2)];
+		readBits(entry>>4);
+		return entry&15;
 	};
 
 	// finally loop
@@ -216,7 +282,7 @@ void IMPDecompressor::decompressImpl(Buffer &rawData,bool verify)
 	uint8_t *dest=rawData.data();
 	size_t destOffset=_rawSize;
 
-	uint32_t litLength=_packedData.readBE32(_endOffset+12);
+	uint32_t litLength=packed.readBE32(_endOffset+12);
 
 	for (;;)
 	{
@@ -226,7 +292,7 @@ void IMPDecompressor::decompressImpl(Buffer &rawData,bool verify)
 		if (!destOffset) break;
 
 		// now the intertwined Huffman table reads.
-		uint32_t i0=lldDecoder.decode(readBit);
+		uint32_t i0=decodeLLD();
 		uint32_t selector=(i0<4)?i0:3;
 		uint32_t count=i0+2;
 		if (count==6)
@@ -243,7 +309,7 @@ void IMPDecompressor::decompressImpl(Buffer &rawData,bool verify)
 			{1,1,1,1},
 			{2,3,3,4},
 			{4,5,7,14}};
-		uint32_t i1=lldDecoder2.decode(readBit);
+		uint32_t i1=decodeLLD2();
 		litLength=i1+i1;
 		if (litLength==4)
 		{
@@ -251,12 +317,12 @@ void IMPDecompressor::decompressImpl(Buffer &rawData,bool verify)
 		}
 		litLength+=readBits(literalBits[i1][selector]);
 
-		uint32_t i2=lldDecoder2.decode(readBit);
+		uint32_t i2=decodeLLD2();
 		uint32_t distance=1+((i2)?distanceValues[i2-1][selector]:0)+readBits(distanceBits[i2][selector]);
 
 		if (destOffset<count || destOffset+distance>_rawSize) throw DecompressionError();
-		distance+=destOffset;
-		for (uint32_t i=0;i<count;i++) dest[--destOffset]=dest[--distance];
+		LZCopyBackward(dest+destOffset,distance,count);
+		destOffset-=count;
 	}
 }
 
@@ -1,6 +1,7 @@
 /* Copyright (C) Teemu Suutari */
 
 #include "LHLBDecompressor.hpp"
+#include "LZCopy.hpp"
 
 bool LHLBDecompressor::detectHeaderXPK(uint32_t hdr) noexcept
 {
@@ -147,8 +148,8 @@ void LHLBDecompressor::decompressImpl(Buffer &rawData,const Buffer &previousData
 				uint32_t count=-(code+256);
 
 				if (!distance || distance>destOffset || destOffset+count>rawSize) throw Decompressor::DecompressionError();
-				for (uint32_t i=0;i<count;i++,destOffset++)
-					dest[destOffset]=dest[destOffset-distance];
+				LZCopyForward(dest+destOffset,distance,count);
+				destOffset+=count;
 			}
 			code=sums[632];
 		}
@@ -1,6 +1,7 @@
 /* Copyright (C) Teemu Suutari */
 
 #include "LIN1Decompressor.hpp"
+#include "LZCopy.hpp"
 
 bool LIN1Decompressor::detectHeaderXPK(uint32_t hdr) noexcept
 {
@@ -125,8 +126,8 @@ void LIN1Decompressor::decompressImpl(Buffer &rawData,const Buffer &previousData
 			if (!count) break;
 
 			if (distance>destOffset) throw Decompressor::DecompressionError();
-			for (uint32_t i=0;i<count;i++,destOffset++)
-				dest[destOffset]=dest[destOffset-distance];
+			LZCopyForward(dest+destOffset,distance,count);
+			destOffset+=count;
 		}
 	}
 
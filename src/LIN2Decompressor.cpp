@@ -2,6 +2,8 @@
 
 #include "LIN2Decompressor.hpp"
 #include "HuffmanDecoder.hpp"
+#include "LZCopy.hpp"
+#include "Span.hpp"
 
 bool LIN2Decompressor::detectHeaderXPK(uint32_t hdr) noexcept
 {
@@ -63,7 +65,8 @@ const std::string &LIN2Decompressor::getSubName() const noexcept
 void LIN2Decompressor::decompressImpl(Buffer &rawData,const Buffer &previousData,bool verify)
 {
 	// Stream reading
-	const uint8_t *bufPtr=_packedData.data();
+	ConstSpan packed(_packedData);
+	const uint8_t *bufPtr=packed.data();
 	size_t bufBitsOffset=10;
 	uint32_t bufBitsContent=0;
 	uint8_t bufBitsLength=0;
@@ -94,7 +97,7 @@ void LIN2Decompressor::decompressImpl(Buffer &rawData,const Buffer &previousData
 	size_t buf4BitsOffset=_endStreamOffset;
 	bool buf4Incomplete=false;
 	{
-		uint8_t tmp=_packedData.read8(9);
+		uint8_t tmp=packed.read8(9);
 		buf4Incomplete=!!tmp;
 		if (buf4Incomplete)
 		{
@@ -235,8 +238,8 @@ void LIN2Decompressor::decompressImpl(Buffer &rawData,const Buffer &previousData
 			if (!count) break;
 
 			if (distance>destOffset || destOffset+count>rawSize) throw Decompressor::DecompressionError();
-			for (uint32_t i=0;i<count;i++,destOffset++)
-				dest[destOffset]=dest[destOffset-distance];
+			LZCopyForward(dest+destOffset,distance,count);
+			destOffset+=count;
 		}
 	}
 
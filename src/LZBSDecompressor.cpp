@@ -1,6 +1,7 @@
 /* Copyright (C) Teemu Suutari */
 
 #include "LZBSDecompressor.hpp"
+#include "LZCopy.hpp"
 
 bool LZBSDecompressor::detectHeaderXPK(uint32_t hdr) noexcept
 {
@@ -80,8 +81,8 @@ void LZBSDecompressor::decompressImpl(Buffer &rawData,const Buffer &previousData
 				uint32_t distance=readBits(bits);
 
 				if (!distance || distance>destOffset || destOffset+count>rawSize) throw Decompressor::DecompressionError();
-				for (uint32_t i=0;i<count;i++,destOffset++)
-					dest[destOffset]=dest[destOffset-distance];
+				LZCopyForward(dest+destOffset,distance,count);
+				destOffset+=count;
 			}
 		}
 	}
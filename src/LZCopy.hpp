@@ -0,0 +1,134 @@
+/* Copyright (C) Teemu Suutari */
+
+#ifndef LZCOPY_HPP
+#define LZCOPY_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Match copy primitives shared by the LZ-family decompressors.
+// Bounds are the responsibility of the caller: nothing is read or written
+// outside of the match itself. Overlapping matches (distance<count) replicate
+// the pattern exactly as a byte-by-byte copy would do.
+
+// Copies count bytes forward to dest from dest-distance
+inline void LZCopyForward(uint8_t *dest,size_t distance,size_t count) noexcept
+{
+	if (!distance) return;
+	const uint8_t *src=dest-distance;
+	if (distance<8 && count>=16)
+	{
+		if (distance==1)
+		{
+			::memset(dest,*src,count);
+			return;
+		}
+		if (distance==2 || distance==4)
+		{
+			// pattern replication with full words
+			uint8_t pattern[8];
+			for (uint32_t i=0;i<8;i++) pattern[i]=src[i%distance];
+			while (count>=8)
+			{
+				::memcpy(dest,pattern,8);
+				dest+=8;
+				count-=8;
+			}
+		} else {
+			// After first bytes the match can be seen as one having multiple of the original distance.
+			// Once it is at least 8 we can continue with words
+			size_t newDistance=distance*((distance+7)/distance);
+			for (size_t i=newDistance-distance;i;i--) *(dest++)=*(src++);
+			count-=newDistance-distance;
+			distance=newDistance;
+		}
+		src=dest-distance;
+	}
+	if (distance>=16)
+	{
+		while (count>=16)
+		{
+			uint8_t tmp[16];
+			::memcpy(tmp,src,16);
+			::memcpy(dest,tmp,16);
+			src+=16;
+			dest+=16;
+			count-=16;
+		}
+	}
+	if (distance>=8)
+	{
+		while (count>=8)
+		{
+			uint8_t tmp[8];
+			::memcpy(tmp,src,8);
+			::memcpy(dest,tmp,8);
+			src+=8;
+			dest+=8;
+			count-=8;
+		}
+	}
+	while (count--) *(dest++)=*(src++);
+}
+
+// Copies count bytes backward, ending at destEnd (exclusive), from destEnd+distance.
+// i.e. the reverse version of the above used by the end-to-start decompressors
+inline void LZCopyBackward(uint8_t *destEnd,size_t distance,size_t count) noexcept
+{
+	if (!distance) return;
+	uint8_t *dest=destEnd;
+	const uint8_t *src=destEnd+distance;
+	if (distance<8 && count>=16)
+	{
+		if (distance==1)
+		{
+			::memset(dest-count,src[-1],count);
+			return;
+		}
+		if (distance==2 || distance==4)
+		{
+			uint8_t pattern[8];
+			for (uint32_t i=0;i<8;i++) pattern[7-i]=src[-1-int32_t(i%distance)];
+			while (count>=8)
+			{
+				dest-=8;
+				::memcpy(dest,pattern,8);
+				count-=8;
+			}
+		} else {
+			size_t newDistance=distance*((distance+7)/distance);
+			for (size_t i=newDistance-distance;i;i--) *(--dest)=*(--src);
+			count-=newDistance-distance;
+			distance=newDistance;
+		}
+		src=dest+distance;
+	}
+	if (distance>=16)
+	{
+		while (count>=16)
+		{
+			uint8_t tmp[16];
+			src-=16;
+			dest-=16;
+			::memcpy(tmp,src,16);
+			::memcpy(dest,tmp,16);
+			count-=16;
+		}
+	}
+	if (distance>=8)
+	{
+		while (count>=8)
+		{
+			uint8_t tmp[8];
+			src-=8;
+			dest-=8;
+			::memcpy(tmp,src,8);
+			::memcpy(dest,tmp,8);
+			count-=8;
+		}
+	}
+	while (count--) *(--dest)=*(--src);
+}
+
+#endif
@@ -1,6 +1,8 @@
 /* Copyright (C) Teemu Suutari */
 
 #include "LZW2Decompressor.hpp"
+#include "FlagLZDecoder.hpp"
+#include "Span.hpp"
 
 bool LZW2Decompressor::detectHeaderXPK(uint32_t hdr) noexcept
 {
@@ -32,61 +34,42 @@ const std::string &LZW2Decompressor::getSubName() const noexcept
 	return (_ver==2)?name2:name3;
 }
 
-void LZW2Decompressor::decompressImpl(Buffer &rawData,const Buffer &previousData,bool verify)
+// control bits are read from the lowest bit
+struct LZW2Policy
 {
-	// Stream reading
-	size_t packedSize=_packedData.size();
-	const uint8_t *bufPtr=_packedData.data();
-	size_t bufOffset=0;
-	uint32_t bufBitsContent=0;
-	uint8_t bufBitsLength=0;
-
-	auto readBit=[&]()->uint8_t
-	{
-		if (!bufBitsLength)
-		{
-			if (bufOffset+3>=packedSize) throw Decompressor::DecompressionError();
-			bufBitsContent=uint32_t(bufPtr[bufOffset++])<<24;
-			bufBitsContent|=uint32_t(bufPtr[bufOffset++])<<16;
-			bufBitsContent|=uint32_t(bufPtr[bufOffset++])<<8;
-			bufBitsContent|=uint32_t(bufPtr[bufOffset++]);
-			bufBitsLength=32;
-		}
-		uint8_t ret=bufBitsContent&1;
-		bufBitsContent>>=1;
-		bufBitsLength--;
-		return ret;
-	};
+	static constexpr uint32_t wordBits=32;
+	static constexpr uint32_t tokenBits=1;
 
-	auto readByte=[&]()->uint8_t
+	static uint32_t readWord(FlagLZStream &stream)
 	{
-		if (bufOffset>=packedSize) throw Decompressor::DecompressionError();
-		return bufPtr[bufOffset++];
-	};
-
-	uint8_t *dest=rawData.data();
-	size_t destOffset=0;
-	size_t rawSize=rawData.size();
+		if (stream.offset+3>=stream.end) throw Decompressor::DecompressionError();
+		uint32_t ret=loadBE32(stream.ptr+stream.offset);
+		stream.offset+=4;
+		ret=((ret>>1)&0x5555'5555U)|((ret&0x5555'5555U)<<1);
+		ret=((ret>>2)&0x3333'3333U)|((ret&0x3333'3333U)<<2);
+		ret=((ret>>4)&0x0f0f'0f0fU)|((ret&0x0f0f'0f0fU)<<4);
+		ret=((ret>>8)&0x00ff'00ffU)|((ret&0x00ff'00ffU)<<8);
+		return (ret>>16)|(ret<<16);
+	}
 
-	while (destOffset!=rawSize)
+	static void decodeToken(FlagLZStream &stream,uint32_t token)
 	{
-		if (!readBit())
-		{
-			dest[destOffset++]=readByte();
-		} else {
-			uint32_t distance=uint32_t(readByte())<<8;
-			distance|=uint32_t(readByte());
-			if (!distance) break;
-			distance=65536-distance;
-			uint32_t count=uint32_t(readByte())+4;
+		uint32_t distance=uint32_t(stream.readByte())<<8;
+		distance|=uint32_t(stream.readByte());
+		// zero distance ends the stream, which is too early here
+		if (!distance) throw Decompressor::DecompressionError();
+		distance=65536-distance;
+		uint32_t count=uint32_t(stream.readByte())+4;
 
-			if (distance>destOffset || destOffset+count>rawSize) throw Decompressor::DecompressionError();
-			for (uint32_t i=0;i<count;i++,destOffset++)
-				dest[destOffset]=dest[destOffset-distance];
-		}
+		if (distance>stream.destOffset || stream.destOffset+count>stream.rawSize) throw Decompressor::DecompressionError();
+		stream.copy(distance,count);
 	}
+};
 
-	if (destOffset!=rawSize) throw Decompressor::DecompressionError();
+void LZW2Decompressor::decompressImpl(Buffer &rawData,const Buffer &previousData,bool verify)
+{
+	FlagLZStream stream{_packedData.data(),0,_packedData.size(),rawData.data(),0,rawData.size()};
+	FlagLZDecode<LZW2Policy>(stream);
 }
 
 XPKDecompressor::Registry<LZW2Decompressor> LZW2Decompressor::_XPKregistration;
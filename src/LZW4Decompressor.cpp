@@ -1,6 +1,8 @@
 /* Copyright (C) Teemu Suutari */
 
 #include "LZW4Decompressor.hpp"
+#include "FlagLZDecoder.hpp"
+#include "Span.hpp"
 
 bool LZW4Decompressor::detectHeaderXPK(uint32_t hdr) noexcept
 {
@@ -30,61 +32,37 @@ const std::string &LZW4Decompressor::getSubName() const noexcept
 	return name;
 }
 
-void LZW4Decompressor::decompressImpl(Buffer &rawData,const Buffer &previousData,bool verify)
+struct LZW4Policy
 {
-	// Stream reading
-	size_t packedSize=_packedData.size();
-	const uint8_t *bufPtr=_packedData.data();
-	size_t bufOffset=0;
-	uint32_t bufBitsContent=0;
-	uint8_t bufBitsLength=0;
+	static constexpr uint32_t wordBits=32;
+	static constexpr uint32_t tokenBits=1;
 
-	auto readBit=[&]()->uint8_t
+	static uint32_t readWord(FlagLZStream &stream)
 	{
-		if (!bufBitsLength)
-		{
-			if (bufOffset+3>=packedSize) throw Decompressor::DecompressionError();
-			bufBitsContent=uint32_t(bufPtr[bufOffset++])<<24;
-			bufBitsContent|=uint32_t(bufPtr[bufOffset++])<<16;
-			bufBitsContent|=uint32_t(bufPtr[bufOffset++])<<8;
-			bufBitsContent|=uint32_t(bufPtr[bufOffset++]);
-			bufBitsLength=32;
-		}
-		uint8_t ret=bufBitsContent>>31;
-		bufBitsContent<<=1;
-		bufBitsLength--;
+		if (stream.offset+3>=stream.end) throw Decompressor::DecompressionError();
+		uint32_t ret=loadBE32(stream.ptr+stream.offset);
+		stream.offset+=4;
 		return ret;
-	};
-
-	auto readByte=[&]()->uint8_t
-	{
-		if (bufOffset>=packedSize) throw Decompressor::DecompressionError();
-		return bufPtr[bufOffset++];
-	};
-
-	uint8_t *dest=rawData.data();
-	size_t destOffset=0;
-	size_t rawSize=rawData.size();
+	}
 
-	while (destOffset!=rawSize)
+	static void decodeToken(FlagLZStream &stream,uint32_t token)
 	{
-		if (!readBit())
-		{
-			dest[destOffset++]=readByte();
-		} else {
-			uint32_t distance=uint32_t(readByte())<<8;
-			distance|=uint32_t(readByte());
-			if (!distance) break;
-			distance=65536-distance;
-			uint32_t count=uint32_t(readByte())+3;
+		uint32_t distance=uint32_t(stream.readByte())<<8;
+		distance|=uint32_t(stream.readByte());
+		// zero distance ends the stream, which is too early here
+		if (!distance) throw Decompressor::DecompressionError();
+		distance=65536-distance;
+		uint32_t count=uint32_t(stream.readByte())+3;
 
-			if (distance>destOffset || destOffset+count>rawSize) throw Decompressor::DecompressionError();
-			for (uint32_t i=0;i<count;i++,destOffset++)
-				dest[destOffset]=dest[destOffset-distance];
-		}
+		if (distance>stream.destOffset || stream.destOffset+count>stream.rawSize) throw Decompressor::DecompressionError();
+		stream.copy(distance,count);
 	}
+};
 
-	if (destOffset!=rawSize) throw Decompressor::DecompressionError();
+void LZW4Decompressor::decompressImpl(Buffer &rawData,const Buffer &previousData,bool verify)
+{
+	FlagLZStream stream{_packedData.data(),0,_packedData.size(),rawData.data(),0,rawData.size()};
+	FlagLZDecode<LZW4Policy>(stream);
 }
 
 XPKDecompressor::Registry<LZW4Decompressor> LZW4Decompressor::_XPKregistration;
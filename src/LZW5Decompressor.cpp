@@ -1,6 +1,8 @@
 /* Copyright (C) Teemu Suutari */
 
 #include "LZW5Decompressor.hpp"
+#include "FlagLZDecoder.hpp"
+#include "Span.hpp"
 
 bool LZW5Decompressor::detectHeaderXPK(uint32_t hdr) noexcept
 {
@@ -30,95 +32,52 @@ const std::string &LZW5Decompressor::getSubName() const noexcept
 	return name;
 }
 
-void LZW5Decompressor::decompressImpl(Buffer &rawData,const Buffer &previousData,bool verify)
+struct LZW5Policy
 {
-	// Stream reading
-	size_t packedSize=_packedData.size();
-	const uint8_t *bufPtr=_packedData.data();
-	size_t bufOffset=0;
-	uint32_t bufBitsContent=0;
-	uint8_t bufBitsLength=0;
+	static constexpr uint32_t wordBits=32;
+	static constexpr uint32_t tokenBits=2;
 
-	auto read2Bits=[&]()->uint8_t
+	static uint32_t readWord(FlagLZStream &stream)
 	{
-		if (!bufBitsLength)
-		{
-			if (bufOffset+3>=packedSize) throw Decompressor::DecompressionError();
-			bufBitsContent=uint32_t(bufPtr[bufOffset++])<<24;
-			bufBitsContent|=uint32_t(bufPtr[bufOffset++])<<16;
-			bufBitsContent|=uint32_t(bufPtr[bufOffset++])<<8;
-			bufBitsContent|=uint32_t(bufPtr[bufOffset++]);
-			bufBitsLength=32;
-		}
-		uint8_t ret=bufBitsContent>>30;
-		bufBitsContent<<=2;
-		bufBitsLength-=2;
+		if (stream.offset+3>=stream.end) throw Decompressor::DecompressionError();
+		uint32_t ret=loadBE32(stream.ptr+stream.offset);
+		stream.offset+=4;
 		return ret;
-	};
-
-	auto readByte=[&]()->uint8_t
-	{
-		if (bufOffset>=packedSize) throw Decompressor::DecompressionError();
-		return bufPtr[bufOffset++];
-	};
-
-	uint8_t *dest=rawData.data();
-	size_t destOffset=0;
-	size_t rawSize=rawData.size();
+	}
 
-	while (destOffset!=rawSize)
+	static void decodeToken(FlagLZStream &stream,uint32_t token)
 	{
-		uint32_t distance,count;
-		bool doCopy=false,doExit=false;
-
-		auto readld=[&]()->uint32_t
+		uint32_t distance=uint32_t(stream.readByte())<<8;
+		distance|=uint32_t(stream.readByte());
+		// zero distance ends the stream, which is too early here
+		if (!distance) throw Decompressor::DecompressionError();
+		uint32_t count;
+		switch (token)
 		{
-			uint32_t ret=uint32_t(readByte())<<8;
-			ret|=uint32_t(readByte());
-			if (!ret) doExit=true;
-			return ret;
-		};
-
-		switch (read2Bits())
-		{
-			case 0:
-			dest[destOffset++]=readByte();
-			break;
-			
 			case 1:
-			distance=readld();
 			count=(distance&3)+2;
 			distance=0x4000-(distance>>2);
-			doCopy=true;
 			break;
 
 			case 2:
-			distance=readld();
 			count=(distance&15)+2;
 			distance=0x1000-(distance>>4);
-			doCopy=true;
 			break;
 
-			case 3:
-			distance=readld();
-			count=uint32_t(readByte())+3;
+			default:
+			count=uint32_t(stream.readByte())+3;
 			distance=0x10000-distance;
-			doCopy=true;
 			break;
-			
-			default:
-			throw Decompressor::DecompressionError();
-		}
-		if (doExit) break;
-		if (doCopy)
-		{
-			if (distance>destOffset || destOffset+count>rawSize) throw Decompressor::DecompressionError();
-			for (uint32_t i=0;i<count;i++,destOffset++)
-				dest[destOffset]=dest[destOffset-distance];
 		}
+		if (distance>stream.destOffset || stream.destOffset+count>stream.rawSize) throw Decompressor::DecompressionError();
+		stream.copy(distance,count);
 	}
+};
 
-	if (destOffset!=rawSize) throw Decompressor::DecompressionError();
+void LZW5Decompressor::decompressImpl(Buffer &rawData,const Buffer &previousData,bool verify)
+{
+	FlagLZStream stream{_packedData.data(),0,_packedData.size(),rawData.data(),0,rawData.size()};
+	FlagLZDecode<LZW5Policy>(stream);
 }
 
 XPKDecompressor::Registry<LZW5Decompressor> LZW5Decompressor::_XPKregistration;
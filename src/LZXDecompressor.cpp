@@ -3,9 +3,11 @@
 #include <stdint.h>
 #include <string.h>
 
+#include <vector>
+
 #include "LZXDecompressor.hpp"
-#include "HuffmanDecoder.hpp"
 #include "DLTADecode.hpp"
+#include "LZCopy.hpp"
 #include <CRC32.hpp>
 
 bool LZXDecompressor::detectHeaderXPK(uint32_t hdr) noexcept
@@ -67,6 +69,80 @@ const std::string &LZXDecompressor::getSubName() const noexcept
 	return (_isSampled)?nameS:nameE;
 }
 
+// Decode table for the LZX codes, bits are read LSB first i.e. the codes are stored bit reversed.
+// Codes up to primaryBits long are decoded with a single lookup, longer ones continue in a secondary
+// table which is indexed with the rest of the bits up to maxDepth.
+// Entries are (value<<6)|length or (offset<<6)|link, 0 is an invalid code
+struct LZXHuffmanTable
+{
+	static constexpr uint32_t maxPrimaryBits=10;
+	static constexpr uint32_t link=0x20;
+
+	std::vector<uint32_t>	entries{0};
+	uint32_t		primaryBits=0;
+	uint32_t		maxDepth=0;
+
+	// no codes: everything decodes as invalid
+	void clear()
+	{
+		entries.assign(1,0);
+		primaryBits=0;
+		maxDepth=0;
+	}
+
+	void create(const uint8_t *bitLengths,uint32_t bitTableLength)
+	{
+		clear();
+		uint32_t counts[17]={0};
+		for (uint32_t i=0;i<bitTableLength;i++)
+		{
+			counts[bitLengths[i]]++;
+			if (bitLengths[i]>maxDepth) maxDepth=bitLengths[i];
+		}
+		if (!maxDepth) return;
+		primaryBits=(maxDepth<maxPrimaryBits)?maxDepth:maxPrimaryBits;
+		uint32_t secondaryBits=maxDepth-primaryBits;
+		entries.assign(size_t(1)<<primaryBits,0);
+
+		// canonical codes in the order of depth and then symbol, like the orderly Huffman table
+		uint32_t nextCode[17];
+		uint32_t code=0;
+		for (uint32_t depth=1;depth<=maxDepth;depth++)
+		{
+			nextCode[depth]=code;
+			code+=counts[depth]<<(maxDepth-depth);
+		}
+		// over-subscribed
+		if (code>(1U<<maxDepth)) throw Decompressor::DecompressionError();
+
+		for (uint32_t i=0;i<bitTableLength;i++)
+		{
+			uint32_t depth=bitLengths[i];
+			if (!depth) continue;
+			uint32_t prefix=nextCode[depth]>>(maxDepth-depth),reversed=0;
+			nextCode[depth]+=1<<(maxDepth-depth);
+			for (uint32_t j=0;j<depth;j++)
+				reversed|=((prefix>>j)&1)<<(depth-j-1);
+			uint32_t entry=(i<<6)|depth;
+			if (depth<=primaryBits)
+			{
+				for (uint32_t j=reversed;j<(1U<<primaryBits);j+=1<<depth)
+					entries[j]=entry;
+			} else {
+				uint32_t index=reversed&((1U<<primaryBits)-1);
+				if (!entries[index])
+				{
+					entries[index]=uint32_t(entries.size()<<6)|link;
+					entries.resize(entries.size()+(size_t(1)<<secondaryBits),0);
+				}
+				size_t offset=entries[index]>>6;
+				for (uint32_t j=reversed>>primaryBits;j<(1U<<secondaryBits);j+=1<<(depth-primaryBits))
+					entries[offset+j]=entry;
+			}
+		}
+	}
+};
+
 void LZXDecompressor::decompressImpl(Buffer &rawData,const Buffer &previousData,bool verify)
 {
 	if (rawData.size()!=_rawSize) throw Decompressor::DecompressionError();
@@ -79,112 +155,106 @@ void LZXDecompressor::decompressImpl(Buffer &rawData,const Buffer &previousData,
 
 	const uint8_t *bufPtr=_packedData.data();
 	size_t bufOffset=_packedOffset;
+	size_t packedSize=_packedSize;
+	size_t rawSize=_rawSize;
 
-	uint8_t bufBitsLength=0;
-	uint32_t bufBitsContent=0;
+	uint32_t bufBitsLength=0;
+	uint64_t bufBitsContent=0;
 
-	// streamreader
-	auto readBit=[&]()->uint8_t
+	// streamreader. LSB first from big endian 16-bit words, bits above bufBitsLength are always zero
+	auto refill=[&]()
 	{
-		uint8_t ret=0;
-		if (!bufBitsLength)
+		while (bufBitsLength<=48 && bufOffset+1<packedSize)
 		{
-			if (bufOffset+1>=_packedSize) throw Decompressor::DecompressionError();
-			bufBitsContent=uint32_t(bufPtr[bufOffset++])<<8;
-			bufBitsContent|=uint32_t(bufPtr[bufOffset++]);
-			bufBitsLength=16;
+			bufBitsContent|=uint64_t((uint32_t(bufPtr[bufOffset])<<8)|bufPtr[bufOffset+1])<<bufBitsLength;
+			bufOffset+=2;
+			bufBitsLength+=16;
 		}
-		ret=bufBitsContent&1;
-		bufBitsContent>>=1;
-		bufBitsLength--;
-		return ret;
+	};
+
+	auto skipBits=[&](uint32_t count)
+	{
+		if (bufBitsLength<count)
+		{
+			refill();
+			if (bufBitsLength<count) throw Decompressor::DecompressionError();
+		}
+		bufBitsContent>>=count;
+		bufBitsLength-=count;
 	};
 
 	auto readBits=[&](uint32_t count)->uint32_t
 	{
-		while (bufBitsLength<count)
+		if (bufBitsLength<count)
 		{
-			if (bufOffset+1>=_packedSize) throw Decompressor::DecompressionError();
-			bufBitsContent|=uint32_t(bufPtr[bufOffset++])<<(bufBitsLength+8);
-			bufBitsContent|=uint32_t(bufPtr[bufOffset++])<<bufBitsLength;
-			bufBitsLength+=16;
+			refill();
+			if (bufBitsLength<count) throw Decompressor::DecompressionError();
 		}
-		uint32_t ret=bufBitsContent&((1<<count)-1);
+		uint32_t ret=uint32_t(bufBitsContent)&((1U<<count)-1);
 		bufBitsContent>>=count;
 		bufBitsLength-=count;
 		return ret;
 	};
 
+	// past the end of the stream the bits read as zero
+	auto peekBits=[&](uint32_t count)->uint32_t
+	{
+		if (bufBitsLength<count) refill();
+		return uint32_t(bufBitsContent)&((1U<<count)-1);
+	};
+
+	auto decode=[&](const LZXHuffmanTable &table)->uint32_t
+	{
+		uint32_t bits=peekBits(table.maxDepth);
+		uint32_t entry=table.entries[bits&((1U<<table.primaryBits)-1)];
+		if (entry&LZXHuffmanTable::link)
+			entry=table.entries[(entry>>6)+(bits>>table.primaryBits)];
+		if (!entry) throw Decompressor::DecompressionError();
+		skipBits(entry&0x1f);
+		return entry>>6;
+	};
+
 	uint8_t *dest=rawData.data();
 	size_t destOffset=0;
 
-	typedef HuffmanDecoder<uint32_t,0x8000'0000U,0> LZXDecoder;
-
 	// possibly padded/reused later if multiple blocks
 	uint8_t literalTable[768];
 	for (uint32_t i=0;i<768;i++) literalTable[i]=0;
-	LZXDecoder literalDecoder;
+	LZXHuffmanTable literalDecoder,bitLengthDecoder,distanceDecoder;
 	uint32_t previousDistance=1;
 
-	while (destOffset!=_rawSize)
+	while (destOffset!=rawSize)
 	{
-
-		auto createHuffmanTable=[&](LZXDecoder &dec,const uint8_t *bitLengths,uint32_t bitTableLength)
-		{
-			uint8_t minDepth=16,maxDepth=0;
-			for (uint32_t i=0;i<bitTableLength;i++)
-			{
-				if (bitLengths[i] && bitLengths[i]<minDepth) minDepth=bitLengths[i];
-				if (bitLengths[i]>maxDepth) maxDepth=bitLengths[i];
-			}
-			if (!maxDepth) return;
-
-			uint32_t code=0;
-			for (uint32_t depth=minDepth;depth<=maxDepth;depth++)
-			{
-				for (uint32_t i=0;i<bitTableLength;i++)
-				{
-					if (bitLengths[i]==depth)
-					{
-						dec.insert(HuffmanCode<uint32_t>{depth,code>>(maxDepth-depth),i});
-						code+=1<<(maxDepth-depth);
-					}
-				}
-			}
-		};
-
 		uint32_t method=readBits(3);
 		if (method<1 || method>3) throw Decompressor::DecompressionError();
 
-		LZXDecoder distanceDecoder;
 		if (method==3)
 		{
 			uint8_t bitLengths[8];
 			for (uint32_t i=0;i<8;i++) bitLengths[i]=readBits(3);
-			createHuffmanTable(distanceDecoder,bitLengths,8);
+			distanceDecoder.create(bitLengths,8);
 		}
 
 		size_t blockLength=readBits(8)<<16;
 		blockLength|=readBits(8)<<8;
 		blockLength|=readBits(8);
-		if (blockLength+destOffset>_rawSize) throw Decompressor::DecompressionError();
+		if (blockLength+destOffset>rawSize) throw Decompressor::DecompressionError();
 
 		if (method!=1)
 		{
-			literalDecoder.reset();
+			literalDecoder.clear();
 			for (uint32_t pos=0,block=0;block<2;block++)
 			{
 				uint32_t adjust=(block)?0:1;
 				uint32_t maxPos=(block)?768:256;
-				LZXDecoder bitLengthDecoder;
 				{
 					uint8_t lengthTable[20];
 					for (uint32_t i=0;i<20;i++) lengthTable[i]=readBits(4);
-					createHuffmanTable(bitLengthDecoder,lengthTable,20);
+					bitLengthDecoder.create(lengthTable,20);
 				}
 				while (pos<maxPos)
 				{
-					uint32_t symbol=bitLengthDecoder.decode(readBit);
+					uint32_t symbol=decode(bitLengthDecoder);
 
 					auto doRepeat=[&](uint32_t count,uint8_t value)
 					{
@@ -210,8 +280,8 @@ void LZXDecompressor::decompressImpl(Buffer &rawData,const Buffer &previousData,
 
 						case 19:
 						{
-							uint32_t count=readBit()+3+adjust;
-							doRepeat(count,symDecode(bitLengthDecoder.decode(readBit)));
+							uint32_t count=readBits(1)+3+adjust;
+							doRepeat(count,symDecode(decode(bitLengthDecoder)));
 						}
 						break;
 
@@ -221,14 +291,13 @@ void LZXDecompressor::decompressImpl(Buffer &rawData,const Buffer &previousData,
 					}
 				}
 			}
-			createHuffmanTable(literalDecoder,literalTable,768);
+			literalDecoder.create(literalTable,768);
 		}
 		
 		while (blockLength)
 		{
-			uint32_t symbol=literalDecoder.decode(readBit);
+			uint32_t symbol=decode(literalDecoder);
 			if (symbol<256) {
-				if (destOffset>=_rawSize) throw Decompressor::DecompressionError();
 				dest[destOffset++]=symbol;
 				blockLength--;
 			} else {
@@ -251,8 +320,7 @@ void LZXDecompressor::decompressImpl(Buffer &rawData,const Buffer &previousData,
 				if (bits>=3 && method==3)
 				{
 					distance+=readBits(bits-3)<<3;
-					uint32_t tmp=distanceDecoder.decode(readBit);
-					distance+=tmp;
+					distance+=decode(distanceDecoder);
 				} else {
 					distance+=readBits(bits);
 					if (!distance) distance=previousDistance;
@@ -260,15 +328,16 @@ void LZXDecompressor::decompressImpl(Buffer &rawData,const Buffer &previousData,
 				previousDistance=distance;
 
 				uint32_t count=ldAdditions[symbol>>5]+readBits(ldBits[symbol>>5])+3;
-				if (distance>destOffset || count>blockLength || destOffset+count>_rawSize) throw Decompressor::DecompressionError();
-				for (uint32_t i=0;i<count;i++,destOffset++,blockLength--)
-					dest[destOffset]=dest[destOffset-distance];
+				if (distance>destOffset || count>blockLength) throw Decompressor::DecompressionError();
+				LZCopyForward(dest+destOffset,distance,count);
+				destOffset+=count;
+				blockLength-=count;
 			}
 		}
 	}
 	if (verify)
 	{
-		uint32_t crc=CRC32(rawData,0,_rawSize,0);
+		uint32_t crc=CRC32(rawData,0,rawSize,0);
 		if (crc!=_rawCRC) throw Decompressor::VerificationError();
 	}
 	if (_isSampled)
@@ -0,0 +1,84 @@
+/* Copyright (C) Teemu Suutari */
+
+#include <algorithm>
+#include <new>
+
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "LazyBuffer.hpp"
+
+static size_t getPageSize() noexcept
+{
+	static size_t pageSize=size_t(::sysconf(_SC_PAGESIZE));
+	return pageSize;
+}
+
+LazyBuffer::LazyBuffer()
+{
+	// nothing needed
+}
+
+LazyBuffer::~LazyBuffer()
+{
+	if (_data) ::munmap(_data,_capacity);
+}
+
+const uint8_t *LazyBuffer::data() const noexcept
+{
+	return _data;
+}
+
+uint8_t *LazyBuffer::data()
+{
+	return _data;
+}
+
+size_t LazyBuffer::size() const noexcept
+{
+	return _size;
+}
+
+bool LazyBuffer::isResizable() const noexcept
+{
+	return true;
+}
+
+void LazyBuffer::resize(size_t newSize)
+{
+	if (newSize>_capacity) reserve(std::max(newSize,_capacity*2));
+		else if (newSize<_size) clear(newSize,_size);
+	_size=newSize;
+}
+
+void LazyBuffer::reserve(size_t newCapacity)
+{
+	size_t pageSize=getPageSize();
+	newCapacity=(newCapacity+pageSize-1)&~(pageSize-1);
+	void *ptr=::mmap(nullptr,newCapacity,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS,-1,0);
+	if (ptr==MAP_FAILED) throw std::bad_alloc();
+	if (_data)
+	{
+		::memcpy(ptr,_data,_size);
+		::munmap(_data,_capacity);
+	}
+	_data=static_cast<uint8_t*>(ptr);
+	_capacity=newCapacity;
+}
+
+// zeroes the range, whole pages are replaced by fresh (uncommitted) ones
+void LazyBuffer::clear(size_t start,size_t end) noexcept
+{
+	size_t pageSize=getPageSize();
+	size_t pageStart=(start+pageSize-1)&~(pageSize-1);
+	if (pageStart>=end)
+	{
+		::memset(_data+start,0,end-start);
+		return;
+	}
+	::memset(_data+start,0,pageStart-start);
+	size_t pageEnd=(end+pageSize-1)&~(pageSize-1);
+	if (::mmap(_data+pageStart,pageEnd-pageStart,PROT_READ|PROT_WRITE,MAP_PRIVATE|MAP_ANONYMOUS|MAP_FIXED,-1,0)==MAP_FAILED)
+		::memset(_data+pageStart,0,end-pageStart);
+}
@@ -0,0 +1,38 @@
+/* Copyright (C) Teemu Suutari */
+
+#ifndef LAZYBUFFER_HPP
+#define LAZYBUFFER_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Buffer.hpp"
+
+// Output buffer for the decompressors. The memory is an anonymous mapping, which the OS
+// populates with zero pages only when they are touched. Thus resizing to the maximum raw size
+// costs practically nothing, and the parts never written by the decompressor are never committed.
+// Contents behave like in VectorBuffer: growing gives zeroes, shrinking discards the tail
+class LazyBuffer : public Buffer
+{
+public:
+	LazyBuffer();
+
+	virtual ~LazyBuffer() override final;
+
+	virtual const uint8_t *data() const noexcept override final;
+	virtual uint8_t *data() override final;
+	virtual size_t size() const noexcept override final;
+
+	virtual bool isResizable() const noexcept override final;
+	virtual void resize(size_t newSize) override final;
+
+private:
+	void reserve(size_t newCapacity);
+	void clear(size_t start,size_t end) noexcept;
+
+	uint8_t		*_data=nullptr;
+	size_t		_size=0;
+	size_t		_capacity=0;
+};
+
+#endif
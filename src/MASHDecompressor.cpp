@@ -2,6 +2,7 @@
 
 #include "MASHDecompressor.hpp"
 #include "HuffmanDecoder.hpp"
+#include "LZCopy.hpp"
 
 bool MASHDecompressor::detectHeaderXPK(uint32_t hdr) noexcept
 {
@@ -128,8 +129,8 @@ void MASHDecompressor::decompressImpl(Buffer &rawData,const Buffer &previousData
 		if (destOffset+count>rawSize)			// there seems to be almost systematic extra one byte at the end of the stream...
 			count=uint32_t(rawSize-destOffset);
 		if (distance>destOffset || destOffset+count>rawSize) throw Decompressor::DecompressionError();
-		for (uint32_t i=0;i<count;i++,destOffset++)
-			dest[destOffset]=dest[destOffset-distance];
+		LZCopyForward(dest+destOffset,distance,count);
+		destOffset+=count;
 	}
 
 	if (destOffset!=rawSize) throw Decompressor::DecompressionError();
@@ -0,0 +1,180 @@
+/* Copyright (C) Teemu Suutari */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <fstream>
+#include <map>
+
+#include "Manifest.hpp"
+#include "Decompressor.hpp"
+#include "CRC32.hpp"
+#include "FileIO.hpp"
+#include "VectorBuffer.hpp"
+#include "LazyBuffer.hpp"
+
+static const char *manifestHeader="# ancient manifest 1: [container_entry:]offset packed_size raw_size raw_crc32 format path";
+
+void writeManifestHeader(FILE *file)
+{
+	fprintf(file,"%s\n",manifestHeader);
+}
+
+void writeManifestEntry(FILE *file,const ManifestEntry &entry)
+{
+	std::string offset=std::to_string(entry.offset);
+	if (entry.hasParent) offset=std::to_string(entry.parentEntry)+":"+offset;
+	std::string crc=entry.hasRawCRC?std::to_string(entry.rawCRC):std::string("-");
+	fprintf(file,"%s\t%zu\t%zu\t%s\t%s\t%s\n",offset.c_str(),entry.packedSize,entry.rawSize,crc.c_str(),entry.name.c_str(),entry.path.c_str());
+}
+
+bool readManifest(const std::string &fileName,std::vector<ManifestEntry> &entries)
+{
+	std::ifstream file(fileName.c_str(),std::ios::in);
+	if (!file.is_open())
+	{
+		fprintf(stderr,"Could not read manifest %s\n",fileName.c_str());
+		return false;
+	}
+	std::string line;
+	while (std::getline(file,line))
+	{
+		if (line.empty() || line[0]=='#') continue;
+		// path is last, it is allowed to contain tabs
+		std::vector<std::string> fields;
+		size_t pos=0;
+		while (fields.size()<5)
+		{
+			size_t next=line.find('\t',pos);
+			if (next==std::string::npos) break;
+			fields.push_back(line.substr(pos,next-pos));
+			pos=next+1;
+		}
+		if (fields.size()!=5)
+		{
+			fprintf(stderr,"Invalid manifest line '%s'\n",line.c_str());
+			return false;
+		}
+		try
+		{
+			size_t separator=fields[0].find(':');
+			bool hasParent=separator!=std::string::npos;
+			ManifestEntry entry{size_t(std::stoull(fields[0].substr(hasParent?separator+1:0))),size_t(std::stoull(fields[1])),size_t(std::stoull(fields[2])),
+				fields[3]!="-",0,fields[4],line.substr(pos),hasParent,0};
+			if (entry.hasRawCRC) entry.rawCRC=uint32_t(std::stoul(fields[3]));
+			if (hasParent)
+			{
+				entry.parentEntry=size_t(std::stoull(fields[0].substr(0,separator)));
+				if (entry.parentEntry>=entries.size()) throw std::out_of_range("container");
+			}
+			entries.push_back(std::move(entry));
+		} catch (const std::exception&) {
+			fprintf(stderr,"Invalid manifest line '%s'\n",line.c_str());
+			return false;
+		}
+	}
+	return true;
+}
+
+std::unique_ptr<Buffer> extractManifestEntry(const std::vector<ManifestEntry> &entries,size_t entryIndex)
+{
+	auto &entry=entries[entryIndex];
+	auto source{entry.hasParent?unpackManifestEntry(entries,entry.parentEntry):readFile(entry.path)};
+	if (!source) return nullptr;
+	if (entry.offset>source->size() || entry.packedSize>source->size()-entry.offset)
+	{
+		fprintf(stderr,"Stream is outside of file %s, has it changed?\n",entry.path.c_str());
+		return nullptr;
+	}
+	std::unique_ptr<Buffer> ret=std::make_unique<VectorBuffer>();
+	ret->resize(entry.packedSize);
+	::memcpy(ret->data(),source->data()+entry.offset,entry.packedSize);
+	return ret;
+}
+
+std::unique_ptr<Buffer> unpackManifestEntry(const std::vector<ManifestEntry> &entries,size_t entryIndex)
+{
+	auto &entry=entries[entryIndex];
+	auto stream{extractManifestEntry(entries,entryIndex)};
+	if (!stream) return nullptr;
+	std::unique_ptr<Buffer> raw=std::make_unique<LazyBuffer>();
+	try
+	{
+		auto decompressor{Decompressor::create(*stream,true,true)};
+		raw->resize((decompressor->getRawSize())?decompressor->getRawSize():Decompressor::getMaxRawSize());
+		decompressor->decompress(*raw,true);
+		raw->resize(decompressor->getRawSize());
+	} catch (const Decompressor::Error&) {
+		fprintf(stderr,"Decompression failed for entry %zu in %s\n",entryIndex,entry.path.c_str());
+		return nullptr;
+	}
+	if (raw->size()!=entry.rawSize || (entry.hasRawCRC && raw->size() && CRC32(*raw,0,raw->size(),0)!=entry.rawCRC))
+	{
+		fprintf(stderr,"Decompressed entry %zu does not match the manifest\n",entryIndex);
+		return nullptr;
+	}
+	return raw;
+}
+
+bool mergeManifests(const std::string &fileName,const std::vector<std::string> &inputs)
+{
+	struct Group
+	{
+		std::string			path;
+		std::vector<ManifestEntry>	entries;
+	};
+	std::map<std::string,Group> groups;
+	for (auto &input : inputs)
+	{
+		std::vector<ManifestEntry> entries;
+		if (!readManifest(input,entries)) return false;
+		for (size_t i=0;i<entries.size();)
+		{
+			size_t start=i;
+			const std::string &path=entries[start].path;
+			Group group{path,{}};
+			for (;i<entries.size() && entries[i].path==path;i++)
+			{
+				ManifestEntry entry=entries[i];
+				if (entry.hasParent)
+				{
+					if (entry.parentEntry<start)
+					{
+						fprintf(stderr,"Invalid container for entry %zu in manifest %s\n",i,input.c_str());
+						return false;
+					}
+					entry.parentEntry-=start;
+				}
+				group.entries.push_back(std::move(entry));
+			}
+			if (groups.find(path)!=groups.end())
+			{
+				fprintf(stderr,"File %s is already in an earlier manifest, skipping it in %s\n",path.c_str(),input.c_str());
+				continue;
+			}
+			groups.emplace(path,std::move(group));
+		}
+	}
+
+	std::unique_ptr<FILE,decltype(&::fclose)> file{::fopen(fileName.c_str(),"w"),::fclose};
+	if (!file)
+	{
+		fprintf(stderr,"Could not write manifest %s\n",fileName.c_str());
+		return false;
+	}
+	writeManifestHeader(file.get());
+	size_t entryCount=0;
+	for (auto &it : groups)
+	{
+		for (auto &entry : it.second.entries)
+		{
+			if (entry.hasParent) entry.parentEntry+=entryCount;
+			writeManifestEntry(file.get(),entry);
+		}
+		entryCount+=it.second.entries.size();
+	}
+	bool success=!::ferror(file.get());
+	success&=!::fclose(file.release());
+	if (!success) fprintf(stderr,"Could not write manifest %s\n",fileName.c_str());
+	return success;
+}
@@ -0,0 +1,49 @@
+/* Copyright (C) Teemu Suutari */
+
+#ifndef MANIFEST_HPP
+#define MANIFEST_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "Buffer.hpp"
+
+// Manifest lists the found streams without copying them. Tab separated text, one stream per line:
+//   <offset> <packed size> <raw size> <raw crc32 or -> <format name> <source path>
+// raw crc is only available when the stream was decompressed during the scan.
+// Streams found in the decompressed data of another stream have offset <container entry>:<offset>,
+// where the container is the number of an earlier line (starting from 0)
+struct ManifestEntry
+{
+	size_t		offset;
+	size_t		packedSize;
+	size_t		rawSize;
+	bool		hasRawCRC;
+	uint32_t	rawCRC;
+	std::string	name;
+	std::string	path;
+	bool		hasParent;
+	size_t		parentEntry;
+};
+
+void writeManifestHeader(FILE *file);
+void writeManifestEntry(FILE *file,const ManifestEntry &entry);
+// invalid lines are reported to stderr
+bool readManifest(const std::string &fileName,std::vector<ManifestEntry> &entries);
+
+// Copies the stream of a manifest entry, unpack also decompresses it. Nested streams are read from
+// the decompressed data of their container. Returns nullptr (reported to stderr) on failure
+std::unique_ptr<Buffer> extractManifestEntry(const std::vector<ManifestEntry> &entries,size_t entryIndex);
+std::unique_ptr<Buffer> unpackManifestEntry(const std::vector<ManifestEntry> &entries,size_t entryIndex);
+
+// Combines manifests (of the scan shards) into one, ordered by the source path. Entries of a file
+// are kept together in their original order, the container entry numbers are renumbered.
+// If the same file is in multiple manifests, the first one is used
+bool mergeManifests(const std::string &fileName,const std::vector<std::string> &inputs);
+
+#endif
@@ -0,0 +1,35 @@
+/* Copyright (C) Teemu Suutari */
+
+#include <sys/mman.h>
+
+#include "MappedBuffer.hpp"
+
+MappedBuffer::MappedBuffer(int fd,size_t size)
+{
+	if (!size) return;
+	// private writable mapping, in case someone writes into it
+	void *ptr=::mmap(nullptr,size,PROT_READ|PROT_WRITE,MAP_PRIVATE,fd,0);
+	if (ptr==MAP_FAILED) return;
+	_data=static_cast<uint8_t*>(ptr);
+	_size=size;
+}
+
+MappedBuffer::~MappedBuffer()
+{
+	if (_data) ::munmap(_data,_size);
+}
+
+const uint8_t *MappedBuffer::data() const noexcept
+{
+	return _data;
+}
+
+uint8_t *MappedBuffer::data()
+{
+	return _data;
+}
+
+size_t MappedBuffer::size() const noexcept
+{
+	return _size;
+}
@@ -0,0 +1,30 @@
+/* Copyright (C) Teemu Suutari */
+
+#ifndef MAPPEDBUFFER_HPP
+#define MAPPEDBUFFER_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "Buffer.hpp"
+
+// Read-only view of a file. The OS reads the pages only when they are accessed,
+// thus parsing the header of a large file does not read all of it
+class MappedBuffer : public Buffer
+{
+public:
+	// empty if the file can't be mapped
+	MappedBuffer(int fd,size_t size);
+
+	virtual ~MappedBuffer() override final;
+
+	virtual const uint8_t *data() const noexcept override final;
+	virtual uint8_t *data() override final;
+	virtual size_t size() const noexcept override final;
+
+private:
+	uint8_t		*_data=nullptr;
+	size_t		_size=0;
+};
+
+#endif
@@ -4,6 +4,7 @@
 
 #include "NUKEDecompressor.hpp"
 #include "DLTADecode.hpp"
+#include "LZCopy.hpp"
 
 bool NUKEDecompressor::detectHeaderXPK(uint32_t hdr) noexcept
 {
@@ -173,8 +174,8 @@ void NUKEDecompressor::decompressImpl(Buffer &rawData,const Buffer &previousData
 			} else count=3+4-count;
 		}
 		if (!distance || size_t(distance)>destOffset || destOffset+count>rawSize) throw Decompressor::DecompressionError();
-		for (uint32_t i=0;i<count;i++,destOffset++)
-			dest[destOffset]=dest[destOffset-distance];
+		LZCopyForward(dest+destOffset,distance,count);
+		destOffset+=count;
 	}
 	if (destOffset!=rawSize) throw Decompressor::DecompressionError();
 	if (_isDUKE)
@@ -1,6 +1,19 @@
 /* Copyright (C) Teemu Suutari */
 
 #include "PPDecompressor.hpp"
+#include "LZCopy.hpp"
+#include "Span.hpp"
+
+static uint32_t reverseBits(uint32_t value,uint32_t count) noexcept
+{
+	if (!count) return 0;
+	value=((value&0x5555'5555U)<<1)|((value>>1)&0x5555'5555U);
+	value=((value&0x3333'3333U)<<2)|((value>>2)&0x3333'3333U);
+	value=((value&0x0f0f'0f0fU)<<4)|((value>>4)&0x0f0f'0f0fU);
+	value=((value&0x00ff'00ffU)<<8)|((value>>8)&0x00ff'00ffU);
+	value=(value<<16)|(value>>16);
+	return value>>(32-count);
+}
 
 PPDecompressor::PPState::PPState(uint32_t mode) :
 	_cachedMode(mode)
@@ -23,6 +36,16 @@ bool PPDecompressor::detectHeaderXPK(uint32_t hdr) noexcept
 	return hdr==FourCC('PWPK');
 }
 
+bool PPDecompressor::probe(const Buffer &packedData,bool exactSizeKnown) noexcept
+{
+	ConstSpan packed(packedData);
+	if (!exactSizeKnown || packed.size()<0x10) return false;
+	uint32_t mode=packed.readBE32Unchecked(4);
+	if (mode!=0x9090909 && mode!=0x90a0a0a && mode!=0x90a0b0b && mode!=0x90a0c0c && mode!=0x90a0c0d) return false;
+	uint32_t tmp=packed.readBE32Unchecked(packed.size()-4);
+	return (tmp>>8) && (tmp&0xff)<0x20 && (tmp>>8)<=getMaxRawSize();
+}
+
 std::unique_ptr<Decompressor> PPDecompressor::create(const Buffer &packedData,bool exactSizeKnown,bool verify)
 {
 	return std::make_unique<PPDecompressor>(packedData,exactSizeKnown,verify);
@@ -44,11 +67,7 @@ PPDecompressor::PPDecompressor(const Buffer &packedData,bool exactSizeKnown,bool
 	if (!detectHeader(hdr)) throw InvalidFormatError(); 
 	uint32_t mode=packedData.readBE32(4);
 	if (mode!=0x9090909 && mode!=0x90a0a0a && mode!=0x90a0b0b && mode!=0x90a0c0c && mode!=0x90a0c0d) throw InvalidFormatError();
-	for (uint32_t i=0;i<4;i++)
-	{
-		_modeTable[i]=mode>>24;
-		mode<<=8;
-	}
+	_mode=mode;
 
 	uint32_t tmp=packedData.readBE32(_dataStart);
 
@@ -78,12 +97,7 @@ PPDecompressor::PPDecompressor(uint32_t hdr,uint32_t recursionLevel,const Buffer
 	}
 
 	static const uint32_t modeMap[5]={0x9090909,0x90a0a0a,0x90a0b0b,0x90a0c0c,0x90a0c0d};
-	mode=modeMap[mode];
-	for (uint32_t i=0;i<4;i++)
-	{
-		_modeTable[i]=mode>>24;
-		mode<<=8;
-	}
+	_mode=modeMap[mode];
 
 	uint32_t tmp=packedData.readBE32(_dataStart);
 
@@ -126,45 +140,84 @@ void PPDecompressor::decompressImpl(Buffer &rawData,bool verify)
 {
 	if (rawData.size()<_rawSize) throw DecompressionError();
 
-	// Stream reading
-	const uint8_t *bufPtr=_packedData.data();
-	size_t bufOffset=_dataStart;
+	switch (_mode)
+	{
+		case 0x9090909:
+		decodeStream<0x9090909>(rawData.data());
+		break;
 
-	uint32_t bufBitsContent=0;
-	uint8_t bufBitsLength=0;
-	size_t minBufOffset=_isXPK?0:8;
+		case 0x90a0a0a:
+		decodeStream<0x90a0a0a>(rawData.data());
+		break;
 
-	auto fillBuffer=[&]() {
-		if (bufOffset+3<=minBufOffset) throw DecompressionError();
-		for (uint32_t i=0;i<4;i++) bufBitsContent=(uint32_t(bufPtr[--bufOffset])<<24)|(bufBitsContent>>8);
-		bufBitsLength=32;
-	};
-	fillBuffer();
-	bufBitsContent>>=_startShift;
-	bufBitsLength-=_startShift;
+		case 0x90a0b0b:
+		decodeStream<0x90a0b0b>(rawData.data());
+		break;
+
+		case 0x90a0c0c:
+		decodeStream<0x90a0c0c>(rawData.data());
+		break;
+
+		case 0x90a0c0d:
+		decodeStream<0x90a0c0d>(rawData.data());
+		break;
+
+		default:
+		throw DecompressionError();
+	}
+}
 
-	auto readBit=[&]()->uint8_t
+// mode is the table of distance bit lengths for the match lengths 2,3,4 and 5+ (highest byte first)
+template<uint32_t mode>
+void PPDecompressor::decodeStream(uint8_t *dest)
+{
+	// Stream reading. Stream is made of 32-bit words, ends at the header.
+	// Bits are taken from the lowest bit, but every value is stored in reverse order. Thus the words are
+	// reversed when loaded, and the values come out as is from the top of the accumulator
+	const uint8_t *bufPtr=_packedData.data();
+	size_t bufOffset=_dataStart;
+	const size_t minOffset=_isXPK?0:8;
+	uint64_t bufBitsContent=0;
+	uint32_t bufBitsLength=0;
+
+	// Prefetch does not fail. Running out of data is an error only when the bits are needed
+	auto refill=[&]()
 	{
-		if (!bufBitsLength) fillBuffer();
-		uint8_t ret=bufBitsContent&1;
-		bufBitsContent>>=1;
-		bufBitsLength--;
-		return ret;
+		if (bufBitsLength<=32 && bufOffset>=minOffset+4)
+		{
+			bufOffset-=4;
+			bufBitsContent|=uint64_t(reverseBits(loadBE32(bufPtr+bufOffset),32))<<(32-bufBitsLength);
+			bufBitsLength+=32;
+			return;
+		}
+		while (bufBitsLength<=56 && bufOffset>minOffset)
+		{
+			bufBitsContent|=uint64_t(reverseBits(bufPtr[--bufOffset],8))<<(56-bufBitsLength);
+			bufBitsLength+=8;
+		}
 	};
 
+	// count 1..32
 	auto readBits=[&](uint32_t count)->uint32_t
 	{
-		uint32_t ret=0;
-		for (uint32_t i=0;i<count;i++) ret=(ret<<1)|readBit();
+		if (bufBitsLength<count)
+		{
+			refill();
+			if (bufBitsLength<count) throw DecompressionError();
+		}
+		uint32_t ret=uint32_t(bufBitsContent>>(64-count));
+		bufBitsContent<<=count;
+		bufBitsLength-=count;
 		return ret;
 	};
 
-	uint8_t *dest=rawData.data();
+	if (_startShift) readBits(_startShift);
+
 	size_t destOffset=_rawSize;
 
 	for (;;)
 	{
-		if (!readBit())
+		if (!readBits(1))
 		{
 			uint32_t count=1;
 			// This does not make much sense I know. But it is what it is...
@@ -175,6 +228,22 @@ void PPDecompressor::decompressImpl(Buffer &rawData,bool verify)
 				if (tmp<3) break;
 			}
 			if (destOffset<count) throw DecompressionError();
+			// 4 literals at a time while there are enough bits loaded.
+			// The first one goes to the highest address
+			for (;;)
+			{
+				if (count>=4 && bufBitsLength<32) refill();
+				if (count<4 || bufBitsLength<32) break;
+				uint32_t tmp=uint32_t(bufBitsContent>>32);
+				bufBitsContent<<=32;
+				bufBitsLength-=32;
+				destOffset-=4;
+				dest[destOffset+3]=tmp>>24;
+				dest[destOffset+2]=tmp>>16;
+				dest[destOffset+1]=tmp>>8;
+				dest[destOffset]=tmp;
+				count-=4;
+			}
 			for (uint32_t i=0;i<count;i++) dest[--destOffset]=readBits(8);
 		}
 		if (!destOffset) break;
@@ -182,7 +251,7 @@ void PPDecompressor::decompressImpl(Buffer &rawData,bool verify)
 		uint32_t count,distance;
 		if (modeIndex==3)
 		{
-			distance=readBits(readBit()?_modeTable[modeIndex]:7)+1;
+			distance=readBits(readBits(1)?(mode&0xff):7)+1;
 			// ditto
 			count=5;
 			for (;;)
@@ -193,11 +262,11 @@ void PPDecompressor::decompressImpl(Buffer &rawData,bool verify)
 			}
 		} else {
 			count=modeIndex+2;
-			distance=readBits(_modeTable[modeIndex])+1;
+			distance=readBits((mode>>(24-modeIndex*8))&0xff)+1;
 		}
 		if (destOffset<count || destOffset+distance>_rawSize) throw DecompressionError();
-		distance+=destOffset;
-		for (uint32_t i=0;i<count;i++) dest[--destOffset]=dest[--distance];
+		LZCopyBackward(dest+destOffset,distance,count);
+		destOffset-=count;
 	}
 }
 
@@ -33,18 +33,22 @@ public:
 	virtual void decompressImpl(Buffer &rawData,const Buffer &previousData,bool verify) override final;
 
 	static bool detectHeader(uint32_t hdr) noexcept;
+	static bool probe(const Buffer &packedData,bool exactSizeKnown) noexcept;
 	static bool detectHeaderXPK(uint32_t hdr) noexcept;
 
 	static std::unique_ptr<Decompressor> create(const Buffer &packedData,bool exactSizeKnown,bool verify);
 	static std::unique_ptr<XPKDecompressor> create(uint32_t hdr,uint32_t recursionLevel,const Buffer &packedData,std::unique_ptr<XPKDecompressor::State> &state,bool verify);
 
 private:
+	template<uint32_t mode>
+	void decodeStream(uint8_t *dest);
+
 	const Buffer	&_packedData;
 
 	size_t		_dataStart=0;
 	size_t		_rawSize=0;
 	uint8_t		_startShift=0;
-	uint8_t		_modeTable[4];
+	uint32_t	_mode=0;
 	bool		_isXPK=false;
 
 	static Decompressor::Registry<PPDecompressor> _registration;
@@ -2,6 +2,7 @@
 
 #include "RAKEDecompressor.hpp"
 #include "HuffmanDecoder.hpp"
+#include "LZCopy.hpp"
 
 bool RAKEDecompressor::detectHeaderXPK(uint32_t hdr) noexcept
 {
@@ -67,10 +68,20 @@ void RAKEDecompressor::decompressImpl(Buffer &rawData,const Buffer &previousData
 		return ret;
 	};
 
+	// bits<32, takes the bits from the word at once
 	auto readBits=[&](uint32_t bits)->uint32_t
 	{
+		if (!bits) return 0;
 		uint32_t ret=0;
-		for (uint32_t i=0;i<bits;i++) ret=(ret<<1)|readBit();
+		if (bufBitsLength<bits)
+		{
+			if (bufBitsLength) ret=bufBitsContent>>(32-bufBitsLength);
+			bits-=bufBitsLength;
+			fillBuffer();
+		}
+		ret=(ret<<bits)|(bufBitsContent>>(32-bits));
+		bufBitsContent<<=bits;
+		bufBitsLength-=bits;
 		return ret;
 	};
 
@@ -157,8 +168,8 @@ void RAKEDecompressor::decompressImpl(Buffer &rawData,const Buffer &previousData
 				}
 			}
 			if (destOffset<count || destOffset+distance>rawSize) throw Decompressor::DecompressionError();
-			distance+=destOffset;
-			for (uint32_t i=0;i<count;i++) dest[--destOffset]=dest[--distance];
+			LZCopyBackward(dest+destOffset,distance,count);
+			destOffset-=count;
 		}
 	}
 }
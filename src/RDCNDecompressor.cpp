@@ -1,6 +1,8 @@
 /* Copyright (C) Teemu Suutari */
 
 #include "RDCNDecompressor.hpp"
+#include "FlagLZDecoder.hpp"
+#include "Span.hpp"
 
 bool RDCNDecompressor::detectHeaderXPK(uint32_t hdr) noexcept
 {
@@ -30,87 +32,66 @@ const std::string &RDCNDecompressor::getSubName() const noexcept
 	return name;
 }
 
-void RDCNDecompressor::decompressImpl(Buffer &rawData,const Buffer &previousData,bool verify)
+struct RDCNPolicy
 {
-	// Stream reading
-	size_t packedSize=_packedData.size();
-	const uint8_t *bufPtr=_packedData.data();
-	size_t bufOffset=0;
-	uint16_t bufBitsContent=0;
-	uint8_t bufBitsLength=0;
+	static constexpr uint32_t wordBits=16;
+	static constexpr uint32_t tokenBits=1;
 
-	auto readBit=[&]()->uint8_t
+	static uint32_t readWord(FlagLZStream &stream)
 	{
-		if (!bufBitsLength)
-		{
-			if (bufOffset+1>=packedSize) throw Decompressor::DecompressionError();
-			bufBitsContent=uint16_t(bufPtr[bufOffset++])<<8;
-			bufBitsContent|=uint16_t(bufPtr[bufOffset++]);
-			bufBitsLength=16;
-		}
-		uint8_t ret=bufBitsContent>>15;
-		bufBitsContent<<=1;
-		bufBitsLength--;
+		if (stream.offset+1>=stream.end) throw Decompressor::DecompressionError();
+		uint32_t ret=loadBE16(stream.ptr+stream.offset);
+		stream.offset+=2;
 		return ret;
-	};
-
-	auto readByte=[&]()->uint8_t
-	{
-		if (bufOffset>=packedSize) throw Decompressor::DecompressionError();
-		return bufPtr[bufOffset++];
-	};
-
-	uint8_t *dest=rawData.data();
-	size_t destOffset=0;
-	size_t rawSize=rawData.size();
+	}
 
-	while (destOffset!=rawSize)
+	static void decodeToken(FlagLZStream &stream,uint32_t token)
 	{
-		if (!readBit())
+		uint8_t tmp=stream.readByte();
+		uint32_t count=tmp&0xf;
+		uint32_t code=tmp>>4;
+		uint32_t distance=0;
+		uint8_t repeatChar=0;
+		bool doRLE=false;
+		switch (code)
 		{
-			dest[destOffset++]=readByte();
-		} else {
-			uint8_t tmp=readByte();
-			uint32_t count=tmp&0xf;
-			uint32_t code=tmp>>4;
-			uint32_t distance=0;
-			uint8_t repeatChar=0;
-			bool doRLE=false;
-			switch (code)
-			{
-				case 0:
-				repeatChar=readByte();
-				count+=3;
-				doRLE=true;
-				break;
+			case 0:
+			repeatChar=stream.readByte();
+			count+=3;
+			doRLE=true;
+			break;
 
-				case 1:
-				count=(count|(uint32_t(readByte())<<4))+19;
-				repeatChar=readByte();
-				doRLE=true;
-				break;
+			case 1:
+			count=(count|(uint32_t(stream.readByte())<<4))+19;
+			repeatChar=stream.readByte();
+			doRLE=true;
+			break;
 
-				case 2:
-				distance=(count|(uint32_t(readByte())<<4))+3;
-				count=uint32_t(readByte())+16;
-				break;
+			case 2:
+			distance=(count|(uint32_t(stream.readByte())<<4))+3;
+			count=uint32_t(stream.readByte())+16;
+			break;
 
-				default: /* 3 to 15 */
-				distance=(count|(uint32_t(readByte())<<4))+3;
-				count=code;
-				break;
-			}
-			if (doRLE)
-			{
-				if (destOffset+count>rawSize) throw Decompressor::DecompressionError();
-				for (uint32_t i=0;i<count;i++) dest[destOffset++]=repeatChar;
-			} else {
-				if (distance>destOffset || destOffset+count>rawSize) throw Decompressor::DecompressionError();
-				for (uint32_t i=0;i<count;i++,destOffset++)
-					dest[destOffset]=dest[destOffset-distance];
-			}
+			default: /* 3 to 15 */
+			distance=(count|(uint32_t(stream.readByte())<<4))+3;
+			count=code;
+			break;
+		}
+		if (doRLE)
+		{
+			if (stream.destOffset+count>stream.rawSize) throw Decompressor::DecompressionError();
+			stream.fill(repeatChar,count);
+		} else {
+			if (distance>stream.destOffset || stream.destOffset+count>stream.rawSize) throw Decompressor::DecompressionError();
+			stream.copy(distance,count);
 		}
 	}
+};
+
+void RDCNDecompressor::decompressImpl(Buffer &rawData,const Buffer &previousData,bool verify)
+{
+	FlagLZStream stream{_packedData.data(),0,_packedData.size(),rawData.data(),0,rawData.size()};
+	FlagLZDecode<RDCNPolicy>(stream);
 }
 
 XPKDecompressor::Registry<RDCNDecompressor> RDCNDecompressor::_XPKregistration;
@@ -1,9 +1,15 @@
 /* Copyright (C) Teemu Suutari */
 
+#include <string.h>
+
 #include <algorithm>
+#include <vector>
 
 #include "RNCDecompressor.hpp"
 #include "HuffmanDecoder.hpp"
+#include "BackwardBitReader.hpp"
+#include "LZCopy.hpp"
+#include "Span.hpp"
 
 static uint16_t RNCCRC(const Buffer &buffer,size_t offset,size_t len)
 {
@@ -39,6 +45,19 @@ bool RNCDecompressor::detectHeader(uint32_t hdr) noexcept
 	return hdr==FourCC('RNC\001') || hdr==FourCC('RNC\002');
 }
 
+bool RNCDecompressor::probe(const Buffer &packedData,bool exactSizeKnown) noexcept
+{
+	ConstSpan packed(packedData);
+	if (packed.size()<12) return false;
+	uint32_t rawSize=packed.readBE32Unchecked(4);
+	uint32_t packedSize=packed.readBE32Unchecked(8);
+	if (!rawSize || !packedSize ||
+		rawSize>getMaxRawSize() || packedSize>getMaxPackedSize()) return false;
+	// old RNC1 has the shortest header
+	size_t hdrSize=(packed.readBE32Unchecked(0)==FourCC('RNC\001'))?12:18;
+	return packedSize+hdrSize<=packed.size();
+}
+
 std::unique_ptr<Decompressor> RNCDecompressor::create(const Buffer &packedData,bool exactSizeKnown,bool verify)
 {
 	return std::make_unique<RNCDecompressor>(packedData,verify);
@@ -155,43 +174,35 @@ void RNCDecompressor::decompressImpl(Buffer &rawData,bool verify)
 void RNCDecompressor::RNC1DecompressOld(Buffer &rawData,bool verify)
 {
 	// Stream reading
-	const uint8_t *bufPtr=_packedData.data();
+	ConstSpan packed(_packedData);
 	size_t bufOffset=_packedSize+12;
 
 	// make sure the anchor-bit is not taken in as a data bit
 	if (bufOffset==12) throw DecompressionError();
-	uint8_t bufBitsContent=bufPtr[--bufOffset];
-	uint8_t bufBitsLength=7;
+	uint8_t anchorByte=packed.read8(--bufOffset);
+	uint32_t anchorBits=7;
 	// the anchor-bit does not seem always to be at the correct place
 	for (uint32_t i=0;i<7;i++)
-		if (bufBitsContent&(1<<i)) break;
-			else bufBitsLength--;
+		if (anchorByte&(1<<i)) break;
+			else anchorBits--;
+
+	// bytes are interleaved into the same stream
+	BackwardBitReader<true> bitReader(packed.data(),bufOffset,12);
+	bitReader.preload(anchorByte>>(8-anchorBits),anchorBits);
 
 	auto readBit=[&]()->uint8_t
 	{
-		if (!bufBitsLength)
-		{
-			if (bufOffset<=12) throw DecompressionError();
-			bufBitsContent=bufPtr[--bufOffset];
-			bufBitsLength=8;
-		}
-		uint8_t ret=bufBitsContent>>7;
-		bufBitsContent<<=1;
-		bufBitsLength--;
-		return ret;
+		return bitReader.readBit();
 	};
 
 	auto readBits=[&](uint32_t count)->uint32_t
 	{
-		uint32_t ret=0;
-		for (uint32_t i=0;i<count;i++) ret=(ret<<1)|uint32_t(readBit());
-		return ret;
+		return bitReader.readBits(count);
 	};
 
 	auto readByte=[&]()->uint8_t
 	{
-		if (bufOffset<=12) throw DecompressionError();
-		return bufPtr[--bufOffset];
+		return bitReader.readByte();
 	};
 
 	HuffmanDecoder<uint8_t,0xffU,2> litDecoder
@@ -271,67 +282,97 @@ void RNCDecompressor::RNC1DecompressOld(Buffer &rawData,bool verify)
 
 		uint32_t distOffset=(distance)?distance+count-1:1;
 		if (destOffset<count || destOffset+distOffset>_rawSize) throw DecompressionError();
-		distOffset+=destOffset;
-		for (uint32_t i=0;i<count;i++) dest[--destOffset]=dest[--distOffset];
+		LZCopyBackward(dest+destOffset,distOffset,count);
+		destOffset-=count;
 	}
 }
 
 void RNCDecompressor::RNC1DecompressNew(Buffer &rawData,bool verify)
 {
 	// Stream reading
-	const uint8_t *bufPtr=_packedData.data()+18;
-	size_t bufOffset=0;
-	uint32_t bufBitsContent=0;
-	uint8_t bufBitsLength=0;
-
-	auto readBits=[&](uint8_t bits)->uint32_t
+	ConstSpan packed=ConstSpan(_packedData).subSpan(18,_packedSize);
+	const uint8_t *bufPtr=packed.data();
+
+	// Bits are read LSB first from 16-bit little endian words. A word is taken from the stream
+	// only when its bits are needed, and the literal bytes are read from the stream position after it.
+	// Full words are loaded ahead into the accumulator anyway: the real position (current word and the bits
+	// left of it) can always be calculated back, since every word except the last odd byte has 16 bits.
+	// That odd byte is loaded only when its bits are actually needed
+	uint64_t acc=0;
+	uint32_t accBits=0;
+	size_t wordOffset=0;
+	bool tailLoaded=false;
+
+	auto refill=[&]()
 	{
-		uint32_t ret=0;
-		uint8_t retBits=0;
-		while (retBits!=bits)
+		while (accBits<=48 && wordOffset+2<=_packedSize)
 		{
-			if (!bufBitsLength)
-			{
-				if (bufOffset>=_packedSize) throw DecompressionError();
-				bufBitsContent=bufPtr[bufOffset++];
-				bufBitsLength=8;
-				if (bufOffset<_packedSize)
-				{
-					bufBitsContent|=bufPtr[bufOffset++]<<8;
-					bufBitsLength+=8;
-				}
-			}
-			uint8_t bitsToTake=std::min<uint8_t>(bits-retBits,bufBitsLength);
-			ret|=(bufBitsContent&((1<<bitsToTake)-1))<<retBits;
-			retBits+=bitsToTake;
-			bufBitsContent>>=bitsToTake;
-			bufBitsLength-=bitsToTake;
+			acc|=uint64_t(packed.readLE16Unchecked(wordOffset))<<accBits;
+			accBits+=16;
+			wordOffset+=2;
 		}
-		return ret;
 	};
 
-	auto readByte=[&]()->uint8_t
+	auto loadTail=[&]()->bool
 	{
-		if (bufOffset>=_packedSize) throw DecompressionError();
-		return bufPtr[bufOffset++];
+		if (tailLoaded || wordOffset>=_packedSize) return false;
+		acc|=uint64_t(bufPtr[wordOffset++])<<accBits;
+		accBits+=8;
+		tailLoaded=true;
+		return true;
 	};
 
+	auto readBits=[&](uint32_t count)->uint32_t
+	{
+		refill();
+		if (count>accBits && (!loadTail() || count>accBits)) throw DecompressionError();
+		uint32_t ret=uint32_t(acc&((uint64_t(1)<<count)-1));
+		acc>>=count;
+		accBits-=count;
+		return ret;
+	};
+
+	uint8_t *dest=rawData.data();
+	size_t destOffset=0;
+
+	auto copyLiterals=[&](size_t count)
+	{
+		if (!count) return;
+		size_t offset=tailLoaded?_packedSize:wordOffset-(accBits>>4)*2;
+		uint32_t bits=tailLoaded?accBits:(accBits&15);
+		if (offset+count>_packedSize)
+		{
+			// whatever there is, is written out before failing
+			::memcpy(dest+destOffset,bufPtr+offset,_packedSize-offset);
+			throw DecompressionError();
+		}
+		::memcpy(dest+destOffset,bufPtr+offset,count);
+		destOffset+=count;
+		acc&=(uint64_t(1)<<bits)-1;
+		accBits=bits;
+		wordOffset=offset+count;
+	};
 
-	typedef HuffmanDecoder<uint32_t,0x100U,0> RNC1HuffmanDecoder;
+	// Flat lookup table indexed by the next maxDepth bits (first bit of the code is the lowest).
+	// Entry has the symbol and the code length, 0 for the invalid codes
+	struct HuffmanTable
+	{
+		std::vector<uint16_t>	entries;
+		uint32_t		mask;
+	};
 
-	// helpers
-	auto readHuffmanTable=[&](RNC1HuffmanDecoder &dec)
+	auto readHuffmanTable=[&](HuffmanTable &table)
 	{
 		uint32_t length=readBits(5);
-		// not much to decode from here...
-		if (!length) return;
 		uint32_t maxDepth=0;
-		uint32_t lengthTable[length];
+		uint8_t lengthTable[32];
 		for (uint32_t i=0;i<length;i++)
 		{
 			lengthTable[i]=readBits(4);
 			if (lengthTable[i]>maxDepth) maxDepth=lengthTable[i];
 		}
+		table.entries.assign(size_t(1)<<maxDepth,0);
+		table.mask=(1U<<maxDepth)-1;
 
 		uint32_t code=0;
 		for (uint32_t depth=1;depth<=maxDepth;depth++)
@@ -340,53 +381,68 @@ void RNCDecompressor::RNC1DecompressNew(Buffer &rawData,bool verify)
 			{
 				if (depth==lengthTable[i])
 				{
-					dec.insert(HuffmanCode<uint32_t>{depth,code>>(maxDepth-depth),i});
+					// over-subscribed
+					if (code>table.mask) throw DecompressionError();
+					uint32_t prefix=code>>(maxDepth-depth),reversed=0;
+					for (uint32_t j=0;j<depth;j++)
+						reversed|=((prefix>>j)&1)<<(depth-j-1);
+					for (uint32_t j=reversed;j<=table.mask;j+=1<<depth)
+						table.entries[j]=uint16_t((i<<4)|depth);
 					code+=1<<(maxDepth-depth);
 				}
 			}
 		}
 	};
 
-	auto huffmanDecode=[&](const RNC1HuffmanDecoder &dec)->int32_t
+	auto huffmanDecode=[&](const HuffmanTable &table)->uint32_t
 	{
+		refill();
+		uint32_t entry=table.entries[acc&table.mask];
+		uint32_t length=entry&15;
+		// lookup can be wrong only when it ran past the loaded bits
+		if ((!entry || length>accBits) && loadTail())
+		{
+			entry=table.entries[acc&table.mask];
+			length=entry&15;
+		}
+		if (!entry || length>accBits) throw DecompressionError();
+		acc>>=length;
+		accBits-=length;
 		// this is kind of non-specced
-		uint32_t ret=dec.decode([&]()->uint32_t{return readBits(1);});
+		uint32_t ret=entry>>4;
 		if (ret>=2)
 			ret=(1<<(ret-1))|readBits(ret-1);
 		return ret;
 	};
 
-	uint8_t *dest=rawData.data();
-	size_t destOffset=0;
-
-	auto processLiterals=[&](const RNC1HuffmanDecoder &dec)
+	auto processLiterals=[&](const HuffmanTable &table)
 	{
-		uint32_t litLength=huffmanDecode(dec);
+		uint32_t litLength=huffmanDecode(table);
 		if (destOffset+litLength>_rawSize) throw DecompressionError();
-		for (uint32_t i=0;i<litLength;i++) dest[destOffset++]=readByte();
+		copyLiterals(litLength);
 	};
 
+	HuffmanTable litTable,distanceTable,lengthTable;
 	readBits(2);
 	for (uint8_t chunks=0;chunks<_chunks;chunks++)
 	{
-		RNC1HuffmanDecoder litDecoder,distanceDecoder,lengthDecoder;
-		readHuffmanTable(litDecoder);
-		readHuffmanTable(distanceDecoder);
-		readHuffmanTable(lengthDecoder);
+		readHuffmanTable(litTable);
+		readHuffmanTable(distanceTable);
+		readHuffmanTable(lengthTable);
 		uint32_t count=readBits(16);
 
 		for (uint32_t sub=1;sub<count;sub++)
 		{
-			processLiterals(litDecoder);
-			uint32_t distance=huffmanDecode(distanceDecoder);
-			uint32_t count=huffmanDecode(lengthDecoder);
+			processLiterals(litTable);
+			uint32_t distance=huffmanDecode(distanceTable);
+			uint32_t count=huffmanDecode(lengthTable);
 			if (size_t(distance+1)>destOffset || destOffset+count+2>_rawSize) throw DecompressionError();
 			distance++;
 			count+=2;
-			for (uint32_t i=0;i<count;i++,destOffset++)
-				dest[destOffset]=dest[destOffset-distance];
+			LZCopyForward(dest+destOffset,distance,count);
+			destOffset+=count;
 		}
-		processLiterals(litDecoder);
+		processLiterals(litTable);
 	}
 
 	if (_rawSize!=destOffset) throw DecompressionError();
@@ -395,34 +451,8 @@ void RNCDecompressor::RNC1DecompressNew(Buffer &rawData,bool verify)
 
 void RNCDecompressor::RNC2Decompress(Buffer &rawData,bool verify)
 {
-	// Stream reading
-	const uint8_t *bufPtr=_packedData.data()+18;
-	size_t bufOffset=0;
-	uint8_t bufBitsContent=0;
-	uint8_t bufBitsLength=0;
-
-	auto readBit=[&]()->uint8_t
-	{
-		if (!bufBitsLength)
-		{
-			if (bufOffset>=_packedSize) throw DecompressionError();
-			bufBitsContent=bufPtr[bufOffset++];
-			bufBitsLength=8;
-		}
-		uint8_t ret=bufBitsContent>>7;
-		bufBitsContent<<=1;
-		bufBitsLength--;
-		return ret;
-	};
-
-	auto readByte=[&]()->uint8_t
-	{
-		if (bufOffset>=_packedSize) throw DecompressionError();
-		return bufPtr[bufOffset++];
-	};
-
 	// Huffman decoding
-	enum class Cmd
+	enum class Cmd : uint8_t
 	{
 		INV,	// Invalid
 		LIT,	// 0, Literal
@@ -433,46 +463,140 @@ void RNCDecompressor::RNC2Decompress(Buffer &rawData,bool verify)
 		
 	};
 
-	HuffmanDecoder<Cmd,Cmd::INV,4> cmdDecoder
+	// The codes are fixed. Instead of walking them bit by bit, they are looked up from flat tables
+	// built (once) from the code definitions below: command together with the length of the move
+	// fits in 5 bits and the distance in 6 bits.
+	struct Command
 	{
-		HuffmanCode<Cmd>{1,0b0000,Cmd::LIT},
-		HuffmanCode<Cmd>{2,0b0010,Cmd::MOV},
-		HuffmanCode<Cmd>{3,0b0110,Cmd::MV2},
-		HuffmanCode<Cmd>{4,0b1110,Cmd::MV3},
-		HuffmanCode<Cmd>{4,0b1111,Cmd::CND}
+		Cmd	cmd;
+		uint8_t	count;
+		uint8_t	length;
 	};
 
-	/* length of 9 is a marker for literals */
-	HuffmanDecoder<uint8_t,0,3> lengthDecoder
+	struct Tables
 	{
-		HuffmanCode<uint8_t>{2,0b000,4},
-		HuffmanCode<uint8_t>{2,0b010,5},
-		HuffmanCode<uint8_t>{3,0b010,6},
-		HuffmanCode<uint8_t>{3,0b011,7},
-		HuffmanCode<uint8_t>{3,0b110,8},
-		HuffmanCode<uint8_t>{3,0b111,9}
+		Command	commands[32];
+		uint8_t	distances[64];		// distance multiplier << 3 | code length
+		uint8_t	literals[256];		// number of leading zero bits i.e. literals
 	};
-	
-	HuffmanDecoder<int8_t,-1,6> distanceDecoder
+
+	static const Tables tables=[]()->Tables
 	{
-		HuffmanCode<int8_t>{1,0b000000,0},
-		HuffmanCode<int8_t>{3,0b000110,1},
-		HuffmanCode<int8_t>{4,0b001000,2},
-		HuffmanCode<int8_t>{4,0b001001,3},
-		HuffmanCode<int8_t>{5,0b010101,4},
-		HuffmanCode<int8_t>{5,0b010111,5},
-		HuffmanCode<int8_t>{5,0b011101,6},
-		HuffmanCode<int8_t>{5,0b011111,7},
-		HuffmanCode<int8_t>{6,0b101000,8},
-		HuffmanCode<int8_t>{6,0b101001,9},
-		HuffmanCode<int8_t>{6,0b101100,10},
-		HuffmanCode<int8_t>{6,0b101101,11},
-		HuffmanCode<int8_t>{6,0b111000,12},
-		HuffmanCode<int8_t>{6,0b111001,13},
-		HuffmanCode<int8_t>{6,0b111100,14},
-		HuffmanCode<int8_t>{6,0b111101,15}
+		HuffmanDecoder<Cmd,Cmd::INV,4> cmdDecoder
+		{
+			HuffmanCode<Cmd>{1,0b0000,Cmd::LIT},
+			HuffmanCode<Cmd>{2,0b0010,Cmd::MOV},
+			HuffmanCode<Cmd>{3,0b0110,Cmd::MV2},
+			HuffmanCode<Cmd>{4,0b1110,Cmd::MV3},
+			HuffmanCode<Cmd>{4,0b1111,Cmd::CND}
+		};
+
+		/* length of 9 is a marker for literals */
+		HuffmanDecoder<uint8_t,0,3> lengthDecoder
+		{
+			HuffmanCode<uint8_t>{2,0b000,4},
+			HuffmanCode<uint8_t>{2,0b010,5},
+			HuffmanCode<uint8_t>{3,0b010,6},
+			HuffmanCode<uint8_t>{3,0b011,7},
+			HuffmanCode<uint8_t>{3,0b110,8},
+			HuffmanCode<uint8_t>{3,0b111,9}
+		};
+		
+		HuffmanDecoder<int8_t,-1,6> distanceDecoder
+		{
+			HuffmanCode<int8_t>{1,0b000000,0},
+			HuffmanCode<int8_t>{3,0b000110,1},
+			HuffmanCode<int8_t>{4,0b001000,2},
+			HuffmanCode<int8_t>{4,0b001001,3},
+			HuffmanCode<int8_t>{5,0b010101,4},
+			HuffmanCode<int8_t>{5,0b010111,5},
+			HuffmanCode<int8_t>{5,0b011101,6},
+			HuffmanCode<int8_t>{5,0b011111,7},
+			HuffmanCode<int8_t>{6,0b101000,8},
+			HuffmanCode<int8_t>{6,0b101001,9},
+			HuffmanCode<int8_t>{6,0b101100,10},
+			HuffmanCode<int8_t>{6,0b101101,11},
+			HuffmanCode<int8_t>{6,0b111000,12},
+			HuffmanCode<int8_t>{6,0b111001,13},
+			HuffmanCode<int8_t>{6,0b111100,14},
+			HuffmanCode<int8_t>{6,0b111101,15}
+		};
+
+		Tables ret;
+		for (uint32_t i=0;i<32;i++)
+		{
+			uint32_t pos=0;
+			auto readBit=[&]()->uint8_t
+			{
+				return (i>>(4-pos++))&1;
+			};
+			Command &command=ret.commands[i];
+			command.cmd=cmdDecoder.decode(readBit);
+			command.count=(command.cmd==Cmd::MOV)?lengthDecoder.decode(readBit):0;
+			command.length=pos;
+		}
+		for (uint32_t i=0;i<64;i++)
+		{
+			uint32_t pos=0;
+			auto readBit=[&]()->uint8_t
+			{
+				return (i>>(5-pos++))&1;
+			};
+			int8_t distMult=distanceDecoder.decode(readBit);
+			ret.distances[i]=(distMult<0)?0:uint8_t((distMult<<3)|pos);
+		}
+		for (uint32_t i=0;i<256;i++)
+		{
+			uint32_t count=0;
+			while (count<8 && !(i&(0x80U>>count))) count++;
+			ret.literals[i]=count;
+		}
+		return ret;
+	}();
+
+	// Stream reading
+	ConstSpan packed=ConstSpan(_packedData).subSpan(18,_packedSize);
+	const uint8_t *bufPtr=packed.data();
+	const size_t packedSize=_packedSize;
+	const size_t rawSize=_rawSize;
+	size_t bufOffset=0;
+	// bits are read MSB first, a new byte is taken from the stream only when its bits are needed.
+	// Bytes are interleaved into the same stream
+	uint32_t bufBitsContent=0;
+	uint32_t bufBitsLength=0;
+
+	// peeks up to 8 bits, missing bits at the end of the stream are zero
+	auto peekBits=[&](uint32_t count)->uint32_t
+	{
+		if (bufBitsLength>=count) return (bufBitsContent>>(bufBitsLength-count))&((1U<<count)-1U);
+		uint32_t next=(bufOffset<packedSize)?bufPtr[bufOffset]:0;
+		return (((bufBitsContent<<8)|next)>>(bufBitsLength+8-count))&((1U<<count)-1U);
+	};
+
+	auto skipBits=[&](uint32_t count)
+	{
+		if (count>bufBitsLength)
+		{
+			if (bufOffset>=packedSize) throw DecompressionError();
+			bufBitsContent=(bufBitsContent<<8)|bufPtr[bufOffset++];
+			bufBitsLength+=8;
+		}
+		bufBitsLength-=count;
+		bufBitsContent&=(1U<<bufBitsLength)-1U;
 	};
 
+	auto readBits=[&](uint32_t count)->uint32_t
+	{
+		uint32_t ret=peekBits(count);
+		skipBits(count);
+		return ret;
+	};
+
+	auto readByte=[&]()->uint8_t
+	{
+		if (bufOffset>=packedSize) throw DecompressionError();
+		return bufPtr[bufOffset++];
+	};
 
 	uint8_t *dest=rawData.data();
 	size_t destOffset=0;
@@ -480,50 +604,69 @@ void RNCDecompressor::RNC2Decompress(Buffer &rawData,bool verify)
 	// helpers
 	auto readDistance=[&]()->uint32_t
 	{
-		int8_t distMult=distanceDecoder.decode(readBit);
-		if (distMult<0) throw DecompressionError();
+		uint32_t entry=tables.distances[peekBits(6)];
+		if (!entry) throw DecompressionError();
+		skipBits(entry&7);
 		uint8_t distByte=readByte();
-		return (uint32_t(distByte)|(uint32_t(distMult)<<8))+1;
+		return (uint32_t(distByte)|((entry>>3)<<8))+1;
 	};
 	
 	auto moveBytes=[&](uint32_t distance,uint32_t count)->void
 	{
-		if (!count || distance>destOffset || destOffset+count>_rawSize) throw DecompressionError();
-		for (uint32_t i=0;i<count;i++,destOffset++)
-			dest[destOffset]=dest[destOffset-distance];
+		if (!count || distance>destOffset || destOffset+count>rawSize) throw DecompressionError();
+		LZCopyForward(dest+destOffset,distance,count);
+		destOffset+=count;
 	};
 
-	readBit();
-	readBit();
+	readBits(2);
 	uint8_t foundChunks=0;
 	bool done=false;
 	while (!done && foundChunks<_chunks)
 	{
-		Cmd cmd=cmdDecoder.decode(readBit);
-		switch (cmd) {
+		// Consecutive literals in the current bit byte have their bytes one after another
+		// in the stream. Those are copied at once (unless it fails, which is left for the generic path)
+		if (bufBitsLength)
+		{
+			uint32_t count=tables.literals[(bufBitsContent<<(8-bufBitsLength))&0xffU];
+			if (count>bufBitsLength) count=bufBitsLength;
+			if (count && destOffset+count<=rawSize && bufOffset+count<=packedSize)
+			{
+				for (uint32_t i=0;i<count;i++)
+					dest[destOffset+i]=bufPtr[bufOffset+i];
+				destOffset+=count;
+				bufOffset+=count;
+				bufBitsLength-=count;
+				continue;
+			}
+		}
+
+		const Command &command=tables.commands[peekBits(5)];
+		skipBits(command.length);
+		switch (command.cmd) {
 			case Cmd::INV:
 			throw DecompressionError();
 			break;
 
 			case Cmd::LIT:
-			if (destOffset>=_rawSize) throw DecompressionError();
+			if (destOffset>=rawSize) throw DecompressionError();
 			dest[destOffset++]=readByte();
 			break;
 
 			case Cmd::MOV:
-			{
-				uint8_t count=lengthDecoder.decode(readBit);
-				if (count!=9)
-					moveBytes(readDistance(),count);
-				else {
-					uint32_t rep=0;
-					for (uint32_t i=0;i<4;i++)
-						rep=(rep<<1)|readBit();
-					rep=(rep+3)*4;
-					if (destOffset+rep>_rawSize) throw DecompressionError();
-					for (uint32_t i=0;i<rep;i++,destOffset++)
-						dest[destOffset]=readByte();
+			if (command.count!=9)
+				moveBytes(readDistance(),command.count);
+			else {
+				uint32_t rep=(readBits(4)+3)*4;
+				if (destOffset+rep>rawSize) throw DecompressionError();
+				if (bufOffset+rep>packedSize)
+				{
+					// whatever there is, is written out before failing
+					::memcpy(dest+destOffset,bufPtr+bufOffset,packedSize-bufOffset);
+					throw DecompressionError();
 				}
+				::memcpy(dest+destOffset,bufPtr+bufOffset,rep);
+				bufOffset+=rep;
+				destOffset+=rep;
 			}
 			break;
 
@@ -542,7 +685,7 @@ void RNCDecompressor::RNC2Decompress(Buffer &rawData,bool verify)
 					moveBytes(readDistance(),uint32_t(count+8));
 				else {
 					foundChunks++;
-					done=!readBit();
+					done=!readBits(1);
 				}
 				
 			}			
@@ -6,6 +6,7 @@
 #include "SDHCDecompressor.hpp"
 #include "XPKMaster.hpp"
 #include "DLTADecode.hpp"
+#include "Span.hpp"
 
 bool SDHCDecompressor::detectHeaderXPK(uint32_t hdr) noexcept
 {
@@ -54,17 +55,18 @@ void SDHCDecompressor::decompressImpl(Buffer &rawData,const Buffer &previousData
 		::memcpy(rawData.data(),src.data(),src.size());
 	}
 
-	size_t length=rawData.size()&~3U;
+	Span raw(rawData);
+	size_t length=raw.size()&~3U;
 
 	auto deltaDecodeMono=[&]()
 	{
-		uint8_t *buf=rawData.data();
+		uint8_t *buf=raw.data();
 
 		uint16_t ctr=0;
 		for (size_t i=0;i<length;i+=2)
 		{
 			uint16_t tmp;
-			tmp=(uint16_t(buf[i])<<8)|uint16_t(buf[i+1]);
+			tmp=raw.readBE16Unchecked(i);
 			ctr+=tmp;
 			buf[i]=ctr>>8;
 			buf[i+1]=ctr;
@@ -73,15 +75,15 @@ void SDHCDecompressor::decompressImpl(Buffer &rawData,const Buffer &previousData
 
 	auto deltaDecodeStereo=[&]()
 	{
-		uint8_t *buf=rawData.data();
+		uint8_t *buf=raw.data();
 
 		uint16_t ctr1=0,ctr2=0;
 		for (size_t i=0;i<length;i+=4)
 		{
 			uint16_t tmp;
-			tmp=(uint16_t(buf[i])<<8)|uint16_t(buf[i+1]);
+			tmp=raw.readBE16Unchecked(i);
 			ctr1+=tmp;
-			tmp=(uint16_t(buf[i+2])<<8)|uint16_t(buf[i+3]);
+			tmp=raw.readBE16Unchecked(i+2);
 			ctr2+=tmp;
 			buf[i]=ctr1>>8;
 			buf[i+1]=ctr1;
@@ -0,0 +1,86 @@
+/* Copyright (C) Teemu Suutari */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "SHA256.hpp"
+
+static const uint32_t SHA256K[64]={
+	0x428a2f98U,0x71374491U,0xb5c0fbcfU,0xe9b5dba5U,0x3956c25bU,0x59f111f1U,0x923f82a4U,0xab1c5ed5U,
+	0xd807aa98U,0x12835b01U,0x243185beU,0x550c7dc3U,0x72be5d74U,0x80deb1feU,0x9bdc06a7U,0xc19bf174U,
+	0xe49b69c1U,0xefbe4786U,0x0fc19dc6U,0x240ca1ccU,0x2de92c6fU,0x4a7484aaU,0x5cb0a9dcU,0x76f988daU,
+	0x983e5152U,0xa831c66dU,0xb00327c8U,0xbf597fc7U,0xc6e00bf3U,0xd5a79147U,0x06ca6351U,0x14292967U,
+	0x27b70a85U,0x2e1b2138U,0x4d2c6dfcU,0x53380d13U,0x650a7354U,0x766a0abbU,0x81c2c92eU,0x92722c85U,
+	0xa2bfe8a1U,0xa81a664bU,0xc24b8b70U,0xc76c51a3U,0xd192e819U,0xd6990624U,0xf40e3585U,0x106aa070U,
+	0x19a4c116U,0x1e376c08U,0x2748774cU,0x34b0bcb5U,0x391c0cb3U,0x4ed8aa4aU,0x5b9cca4fU,0x682e6ff3U,
+	0x748f82eeU,0x78a5636fU,0x84c87814U,0x8cc70208U,0x90befffaU,0xa4506cebU,0xbef9a3f7U,0xc67178f2U};
+
+static inline uint32_t rotr(uint32_t value,uint32_t count) noexcept
+{
+	return (value>>count)|(value<<(32-count));
+}
+
+static void SHA256Block(uint32_t state[8],const uint8_t *block) noexcept
+{
+	uint32_t w[64];
+	for (uint32_t i=0;i<16;i++)
+		w[i]=(uint32_t(block[i*4])<<24)|(uint32_t(block[i*4+1])<<16)|(uint32_t(block[i*4+2])<<8)|uint32_t(block[i*4+3]);
+	for (uint32_t i=16;i<64;i++)
+	{
+		uint32_t s0=rotr(w[i-15],7)^rotr(w[i-15],18)^(w[i-15]>>3);
+		uint32_t s1=rotr(w[i-2],17)^rotr(w[i-2],19)^(w[i-2]>>10);
+		w[i]=w[i-16]+s0+w[i-7]+s1;
+	}
+
+	uint32_t a=state[0],b=state[1],c=state[2],d=state[3],e=state[4],f=state[5],g=state[6],h=state[7];
+	for (uint32_t i=0;i<64;i++)
+	{
+		uint32_t t1=h+(rotr(e,6)^rotr(e,11)^rotr(e,25))+((e&f)^(~e&g))+SHA256K[i]+w[i];
+		uint32_t t2=(rotr(a,2)^rotr(a,13)^rotr(a,22))+((a&b)^(a&c)^(b&c));
+		h=g;
+		g=f;
+		f=e;
+		e=d+t1;
+		d=c;
+		c=b;
+		b=a;
+		a=t1+t2;
+	}
+	state[0]+=a;
+	state[1]+=b;
+	state[2]+=c;
+	state[3]+=d;
+	state[4]+=e;
+	state[5]+=f;
+	state[6]+=g;
+	state[7]+=h;
+}
+
+SHA256Digest SHA256(const Buffer &buffer,size_t offset,size_t len)
+{
+	if (offset+len>buffer.size() || offset+len<offset) throw Buffer::OutOfBoundsError();
+	const uint8_t *ptr=buffer.data()+offset;
+
+	uint32_t state[8]={0x6a09e667U,0xbb67ae85U,0x3c6ef372U,0xa54ff53aU,0x510e527fU,0x9b05688cU,0x1f83d9abU,0x5be0cd19U};
+	size_t i=0;
+	for (;i+64<=len;i+=64)
+		SHA256Block(state,ptr+i);
+
+	// padding: 0x80, zeros and the length in bits, one or two blocks
+	uint8_t tail[128]={0};
+	size_t tailLength=len-i;
+	if (tailLength) ::memcpy(tail,ptr+i,tailLength);
+	tail[tailLength]=0x80;
+	size_t tailBlocks=(tailLength<56)?1:2;
+	uint64_t bits=uint64_t(len)<<3;
+	for (uint32_t j=0;j<8;j++)
+		tail[tailBlocks*64-1-j]=uint8_t(bits>>(j*8));
+	for (size_t j=0;j<tailBlocks;j++)
+		SHA256Block(state,tail+j*64);
+
+	SHA256Digest ret;
+	for (uint32_t j=0;j<8;j++)
+		for (uint32_t k=0;k<4;k++)
+			ret[j*4+k]=uint8_t(state[j]>>(24-k*8));
+	return ret;
+}
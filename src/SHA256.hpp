@@ -0,0 +1,18 @@
+/* Copyright (C) Teemu Suutari */
+
+#ifndef SHA256_HPP
+#define SHA256_HPP
+
+#include <stdint.h>
+
+#include <array>
+
+#include "Buffer.hpp"
+
+// SHA-256 (FIPS 180-4), for telling apart contents that must not be mixed up even when crafted to collide
+
+using SHA256Digest=std::array<uint8_t,32>;
+
+SHA256Digest SHA256(const Buffer &buffer,size_t offset,size_t len);
+
+#endif
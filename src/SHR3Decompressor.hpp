@@ -7,19 +7,6 @@
 
 class SHR3Decompressor : public XPKDecompressor
 {
-private:
-	class SHR3State : public XPKDecompressor::State
-	{
-	public:
-		SHR3State() noexcept;
-		virtual ~SHR3State();
-
-		uint32_t vlen=0;
-		uint32_t vnext=0;
-		uint32_t shift=0;
-		uint32_t ar[999];
-	};
-
 public:
 	SHR3Decompressor(uint32_t hdr,uint32_t recursionLevel,const Buffer &packedData,std::unique_ptr<XPKDecompressor::State> &state,bool verify);
 
@@ -7,19 +7,6 @@
 
 class SHRIDecompressor : public XPKDecompressor
 {
-private:
-	class SHRIState : public XPKDecompressor::State
-	{
-	public:
-		SHRIState() noexcept;
-		virtual ~SHRIState();
-
-		uint32_t vlen=0;
-		uint32_t vnext=0;
-		uint32_t shift=0;
-		uint32_t ar[999];
-	};
-
 public:
 	SHRIDecompressor(uint32_t hdr,uint32_t recursionLevel,const Buffer &packedData,std::unique_ptr<XPKDecompressor::State> &state,bool verify);
 
@@ -0,0 +1,353 @@
+/* Copyright (C) Teemu Suutari */
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "SHRXDecoder.hpp"
+#include "LZCopy.hpp"
+#include "Span.hpp"
+
+SHRXDecoder::Model::Model() noexcept
+{
+	// nothing needed, init() is called before first use
+}
+
+SHRXDecoder::Model::~Model()
+{
+	// nothing needed
+}
+
+void SHRXDecoder::Model::init() noexcept
+{
+	for (uint32_t i=0;i<symbolCount;i++)
+	{
+		uint32_t symbol=positionToSymbol(i);
+		_freq[i]=(symbol<256)?((symbol<32||symbol>126)?1:3):0;
+	}
+	rescale();
+}
+
+uint32_t SHRXDecoder::Model::find(uint32_t threshold,uint32_t &prefix) const noexcept
+{
+	uint32_t pos=0,sum=0;
+	for (uint32_t step=256;step;step>>=1)
+	{
+		uint32_t next=pos+step;
+		if (next<=symbolCount && sum+_tree[next]<=threshold)
+		{
+			pos=next;
+			sum+=_tree[next];
+		}
+	}
+	prefix=sum;
+	return pos;
+}
+
+void SHRXDecoder::Model::update(uint32_t symbol,uint32_t increment) noexcept
+{
+	if (symbol>=symbolCount) return;
+	uint32_t pos=symbolToPosition(symbol);
+	_freq[pos]+=increment;
+	for (uint32_t i=pos+1;i<=symbolCount;i+=i&-i)
+		_tree[i]+=increment;
+	_total+=increment;
+	if (_total>=0x2000)
+	{
+		for (uint32_t i=0;i<symbolCount;i++)
+			if (_freq[i]) _freq[i]=(_freq[i]>>1)+1;
+		rescale();
+	}
+}
+
+// rebuilds the tree and the total in linear time
+void SHRXDecoder::Model::rescale() noexcept
+{
+	_total=0;
+	_tree[0]=0;
+	for (uint32_t i=0;i<symbolCount;i++)
+	{
+		_tree[i+1]=_freq[i];
+		_total+=_freq[i];
+	}
+	for (uint32_t i=1;i<=symbolCount;i++)
+	{
+		uint32_t parent=i+(i&-i);
+		if (parent<=symbolCount) _tree[parent]+=_tree[i];
+	}
+}
+
+SHRXDecoder::State::State() noexcept
+{
+	// nothing needed
+}
+
+SHRXDecoder::State::~State()
+{
+	// nothing needed
+}
+
+// Both formats scale the range with same 16x32-bit fixed point multiplication. They differ in
+// what is being scaled: SHRI scales with a/b (2 divisions per call), SHR3 with 1/b
+static uint32_t scaleMultiply(uint64_t quotient,uint32_t mult) noexcept
+{
+	uint32_t tmp=uint32_t(quotient>>16);
+	uint32_t tmp2=uint32_t(quotient&0xffffU);
+	return ((mult&0xffffU)*tmp>>16)+((mult>>16)*tmp2>>16)+(mult>>16)*tmp;
+}
+
+template<bool isSHR3>
+static void SHRXDecode(Buffer &rawData,const Buffer &previousData,const Buffer &packedData,size_t startOffset,SHRXDecoder::State &state,bool initState)
+{
+	typedef SHRXDecoder::Model Model;
+
+	// stream reading
+	ConstSpan packed(packedData);
+	const uint8_t *bufPtr=packed.data();
+	size_t bufOffset=startOffset;
+	size_t packedSize=packed.size();
+
+	uint8_t *dest=rawData.data();
+	size_t destOffset=0;
+	size_t rawSize=rawData.size();
+
+	const uint8_t *prev=previousData.data();
+	size_t prevSize=previousData.size();
+
+	// This follows quite closely Choloks pascal reference.
+	// The model is updated in place, scalars are kept in locals for the duration of the chunk
+	Model &model=state.model;
+	uint32_t vlen=0,vnext=0;
+	uint32_t stream=0,shift=0;
+
+	auto upgrade=[&]()
+	{
+		if (vnext>=65532)
+		{
+			vnext=~0U;
+		} else if (!vlen) {
+			vnext=1;
+		} else {
+			uint32_t vvalue=vnext-1;
+			if (vvalue<48) model.update(vvalue+256,1);
+			uint32_t bits=0,compare=4;
+			while (vvalue>=compare)
+			{
+				vvalue-=compare;
+				compare<<=1;
+				bits++;
+			}
+			if (bits>=14)
+			{
+				vnext=~0U;
+			} else {
+				if (!vvalue)
+				{
+					if (bits<7)
+					{
+						for (uint32_t i=304;i<=307;i++)
+							model.update((bits<<2)+i,1);
+					}
+					if (bits<13)
+					{
+						for (uint32_t i=332;i<=333;i++)
+							model.update((bits<<1)+i,1);
+					}
+					static const uint32_t updates1[6]={358,359,386,387,414,415};
+					static const uint32_t updates2[4]={442,456,470,484};
+					for (auto it : updates1)
+						model.update((bits<<1)+it,1);
+					for (auto it : updates2)
+						model.update(bits+it,1);
+				}
+				if (vnext<49)
+				{
+					vnext++;
+				} else if (vnext==49) {
+					vnext=61;
+				} else {
+					vnext=(vnext<<1)+3;
+				}
+			}
+		}
+	};
+
+	auto refillStream=[&]()
+	{
+		while (shift<0x100'0000)
+		{
+			if (bufOffset>=packedSize) throw Decompressor::DecompressionError();
+			stream=(stream<<8)|uint32_t(bufPtr[bufOffset++]);
+			shift<<=8;
+		}
+	};
+
+	auto getSymbol=[&]()->uint32_t
+	{
+		if (!(shift>>16)) throw Decompressor::DecompressionError();
+		uint32_t total=model.getTotal();
+		if (!total) throw Decompressor::DecompressionError();
+
+		// The model keeps total below 0x2000, thus instead of dividing for every scaling
+		// we can use a reciprocal of the total. The estimate (a*reciprocal)>>16 can be one
+		// short of floor((a<<32)/total) for a<=total, which is fixed by a single compare.
+		// For SHR3 the scale is constant for the symbol, only the reciprocal is needed
+		uint64_t reciprocal=0;
+		uint32_t rawValue=0;
+		if (isSHR3)
+		{
+			rawValue=scaleMultiply((uint64_t(1)<<32)/total,shift);
+		} else {
+			reciprocal=(uint64_t(1)<<48)/total;
+		}
+		auto scale=[&](uint32_t a)->uint32_t
+		{
+			if (isSHR3) return rawValue*a;
+			uint64_t quotient=(uint64_t(a)*reciprocal)>>16;
+			if ((quotient+1)*total<=(uint64_t(a)<<32)) quotient++;
+			return scaleMultiply(quotient,shift);
+		};
+
+		uint32_t vvalue=(stream/(shift>>16))&0xffff;
+		uint32_t threshold=(total*vvalue)>>16;
+		uint32_t result;
+		uint32_t pos=model.find(threshold,result);
+		uint32_t newValue=scale(result);
+		if (newValue>stream)
+		{
+			while (newValue>stream)
+			{
+				pos=(pos?pos:Model::symbolCount)-1;
+				result-=model.getFrequency(pos);
+				newValue=scale(result);
+			}
+		} else {
+			result+=model.getFrequency(pos);
+			while (result<total)
+			{
+				uint32_t compare=scale(result);
+				if (stream<compare) break;
+				if (++pos==Model::symbolCount) pos=0;
+				result+=model.getFrequency(pos);
+				newValue=compare;
+			}
+		}
+		stream-=newValue;
+		shift=scale(model.getFrequency(pos));
+		uint32_t symbol=Model::positionToSymbol(pos);
+		model.update(symbol,(total>>10)+3);
+		refillStream();
+		return symbol;
+	};
+
+	auto getCode=[&](uint32_t size)->uint32_t
+	{
+		uint32_t ret=0;
+		while (size--)
+		{
+			ret<<=1;
+			shift>>=1;
+			if (stream>=shift)
+			{
+				ret++;
+				stream-=shift;
+			}
+			refillStream();
+		}
+		return ret;
+	};
+
+	if (initState)
+	{
+		model.init();
+		model.update(498,1);
+
+		shift=0x8000'0000U;
+	} else {
+		vlen=state.vlen;
+		vnext=state.vnext;
+		shift=state.shift;
+	}
+	if (bufOffset+4>packedSize) throw Decompressor::DecompressionError();
+	stream=packed.readBE32Unchecked(bufOffset);
+	bufOffset+=4;
+
+	while (destOffset!=rawSize)
+	{
+		while (vlen>=vnext) upgrade();
+		uint32_t code=getSymbol();
+		if (code<256)
+		{
+			dest[destOffset++]=code;
+			vlen++;
+		} else {
+		 	auto distanceAddition=[](uint32_t i)->uint32_t
+		 	{
+		 		return ((1<<(i+2))-1)&~0x3U;
+		 	};
+
+		 	uint32_t count,distance;
+			if (code<304)
+			{
+				count=2;
+				distance=code-255;
+			} else if (code<332) {
+				uint32_t tmp=code-304;
+				uint32_t extra=getCode(tmp>>2);
+				distance=((extra<<2)|(tmp&3))+distanceAddition(tmp>>2)+1;
+				count=3;
+			} else if (code<358) {
+				uint32_t tmp=code-332;
+				uint32_t extra=getCode((tmp>>1)+1);
+				distance=((extra<<1)|(tmp&1))+distanceAddition(tmp>>1)+1;
+				count=4;
+			} else if (code<386) {
+				uint32_t tmp=code-358;
+				uint32_t extra=getCode((tmp>>1)+1);
+				distance=((extra<<1)|(tmp&1))+distanceAddition(tmp>>1)+1;
+				count=5;
+			} else if (code<414) {
+				uint32_t tmp=code-386;
+				uint32_t extra=getCode((tmp>>1)+1);
+				distance=((extra<<1)|(tmp&1))+distanceAddition(tmp>>1)+1;
+				count=6;
+			} else if (code<442) {
+				uint32_t tmp=code-414;
+				uint32_t extra=getCode((tmp>>1)+1);
+				distance=((extra<<1)|(tmp&1))+distanceAddition(tmp>>1)+1;
+				count=7;
+			} else if (code<498) {
+				uint32_t tmp=code-442;
+				uint32_t d=tmp/14;
+				uint32_t m=tmp%14;
+				count=getCode(d+2)+distanceAddition(d)+8;
+				distance=getCode(m+2)+distanceAddition(m)+1;
+			} else {
+				count=getCode(16);
+				distance=getCode(16);
+			}
+			vlen+=count;
+			if (!count || !distance || distance>destOffset+prevSize || destOffset+count>rawSize) throw Decompressor::DecompressionError();
+			if (distance>destOffset)
+			{
+				// beginning of the match is in the previous chunk
+				uint32_t prevCount=std::min(count,uint32_t(distance-destOffset));
+				::memcpy(dest+destOffset,prev+prevSize+destOffset-distance,prevCount);
+				destOffset+=prevCount;
+				count-=prevCount;
+			}
+			LZCopyForward(dest+destOffset,distance,count);
+			destOffset+=count;
+		}
+	}
+
+	state.vlen=vlen;
+	state.vnext=vnext;
+	state.shift=shift;
+}
+
+void SHRXDecoder::decode(Buffer &rawData,const Buffer &previousData,const Buffer &packedData,size_t startOffset,State &state,bool initState,bool isSHR3)
+{
+	if (isSHR3) SHRXDecode<true>(rawData,previousData,packedData,startOffset,state,initState);
+		else SHRXDecode<false>(rawData,previousData,packedData,startOffset,state,initState);
+}
@@ -0,0 +1,71 @@
+/* Copyright (C) Teemu Suutari */
+
+#ifndef SHRXDECODER_HPP
+#define SHRXDECODER_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "XPKDecompressor.hpp"
+
+// Common decoding engine for SHRI and SHR3. Both share the adaptive model and
+// the LZ layer, only the range scaling differs between the formats
+
+class SHRXDecoder
+{
+public:
+	// Adaptive frequency model for the 499 symbols.
+	// The original implementation uses a heap-ordered binary tree, whose leaf order
+	// is symbols 13-498 followed by 0-12. The model keeps the frequencies in that same
+	// order (the position) in a Fenwick tree so that the cumulative values match exactly.
+	// Contents are undefined until init() is called
+	class Model
+	{
+	public:
+		static constexpr uint32_t symbolCount=499;
+
+		Model() noexcept;
+		~Model();
+
+		void init() noexcept;
+
+		uint32_t getTotal() const noexcept { return _total; }
+		uint32_t getFrequency(uint32_t pos) const noexcept { return _freq[pos]; }
+
+		// returns position of the first symbol whose cumulative frequency exceeds the threshold.
+		// cumulative frequency preceding it is stored into prefix
+		uint32_t find(uint32_t threshold,uint32_t &prefix) const noexcept;
+
+		void update(uint32_t symbol,uint32_t increment) noexcept;
+
+		static uint32_t positionToSymbol(uint32_t pos) noexcept { return (pos>=486)?pos-486:pos+13; }
+		static uint32_t symbolToPosition(uint32_t symbol) noexcept { return (symbol<13)?symbol+486:symbol-13; }
+
+	private:
+		void rescale() noexcept;
+
+		uint32_t	_total=0;
+		uint32_t	_freq[symbolCount];
+		uint32_t	_tree[symbolCount+1];
+	};
+
+	class State : public XPKDecompressor::State
+	{
+	public:
+		State() noexcept;
+		virtual ~State();
+
+		uint32_t	vlen=0;
+		uint32_t	vnext=0;
+		uint32_t	shift=0;
+		Model		model;
+	};
+
+	SHRXDecoder()=delete;
+
+	// decodes single chunk, starting from startOffset in packedData.
+	// if initState is set, the state is reset before decoding. The state is operated on in place
+	static void decode(Buffer &rawData,const Buffer &previousData,const Buffer &packedData,size_t startOffset,State &state,bool initState,bool isSHR3);
+};
+
+#endif
@@ -1,6 +1,7 @@
 /* Copyright (C) Teemu Suutari */
 
 #include "SLZ3Decompressor.hpp"
+#include "LZCopy.hpp"
 
 bool SLZ3Decompressor::detectHeaderXPK(uint32_t hdr) noexcept
 {
@@ -75,8 +76,8 @@ void SLZ3Decompressor::decompressImpl(Buffer &rawData,const Buffer &previousData
 			distance|=uint32_t(readByte());
 			uint32_t count=uint32_t(tmp&0xf)+2;
 			if (!distance || distance>destOffset || destOffset+count>rawSize) throw Decompressor::DecompressionError();
-			for (uint32_t i=0;i<count;i++,destOffset++)
-				dest[destOffset]=dest[destOffset-distance];
+			LZCopyForward(dest+destOffset,distance,count);
+			destOffset+=count;
 		}
 	}
 
@@ -1,7 +1,7 @@
 /* Copyright (C) Teemu Suutari */
 
 #include "SMPLDecompressor.hpp"
-#include "HuffmanDecoder.hpp"
+#include "ByteHuffmanDecoder.hpp"
 
 bool SMPLDecompressor::detectHeaderXPK(uint32_t hdr) noexcept
 {
@@ -43,17 +43,6 @@ void SMPLDecompressor::decompressImpl(Buffer &rawData,const Buffer &previousData
 	uint8_t bufBitsContent=0;
 	uint8_t bufBitsLength=0;
 
-	auto readBit=[&]()->uint8_t
-	{
-		if (!bufBitsLength)
-		{
-			if (bufOffset>=packedSize) throw Decompressor::DecompressionError();
-			bufBitsContent=bufPtr[bufOffset++];
-			bufBitsLength=8;
-		}
-		return (bufBitsContent>>(--bufBitsLength))&1;
-	};
-
 	auto readBits=[&](uint32_t count)->uint32_t
 	{
 		uint32_t ret=0;
@@ -76,11 +65,7 @@ void SMPLDecompressor::decompressImpl(Buffer &rawData,const Buffer &previousData
 		return ret;
 	};
 	
-	uint8_t *dest=rawData.data();
-	size_t rawSize=rawData.size();
-	size_t destOffset=0;
-
-	HuffmanDecoder<uint32_t,0x100,0> decoder;
+	ByteHuffmanDecoder decoder;
 
 	for (uint32_t i=0;i<256;i++)
 	{
@@ -91,13 +76,8 @@ void SMPLDecompressor::decompressImpl(Buffer &rawData,const Buffer &previousData
 		decoder.insert(HuffmanCode<uint32_t>{codeLength,code,i});
 	}
 
-	uint8_t accum=0;
-	while (destOffset!=rawSize)
-	{
-		uint32_t code=decoder.decode(readBit);
-		accum+=code;
-		dest[destOffset++]=accum;
-	}
+	// delta is applied while decoding
+	decoder.decode<true>(rawData.data(),rawData.size(),bufPtr,bufOffset,packedSize,bufBitsContent&((1U<<bufBitsLength)-1),bufBitsLength);
 }
 
 XPKDecompressor::Registry<SMPLDecompressor> SMPLDecompressor::_XPKregistration;
@@ -2,6 +2,7 @@
 
 #include "SQSHDecompressor.hpp"
 #include "HuffmanDecoder.hpp"
+#include "LZCopy.hpp"
 
 bool SQSHDecompressor::detectHeaderXPK(uint32_t hdr) noexcept
 {
@@ -37,25 +38,43 @@ void SQSHDecompressor::decompressImpl(Buffer &rawData,const Buffer &previousData
 {
 	if (rawData.size()!=_rawSize) throw Decompressor::DecompressionError();
 
-	// Stream reading
+	// Stream reading. MSB first, the accumulator is kept as full as the stream allows
 	size_t packedSize=_packedData.size();
 	const uint8_t *bufPtr=_packedData.data();
 	size_t bufOffset=2;
-	uint32_t bufBitsContent=0;
-	uint8_t bufBitsLength=0;
+	uint64_t bufBitsContent=0;
+	uint32_t bufBitsLength=0;
 
-	auto readBits=[&](uint8_t bits)->uint32_t
+	auto refill=[&]()
 	{
-		while (bufBitsLength<bits)
+		if (bufOffset+8<=packedSize)
+		{
+			uint32_t count=(63-bufBitsLength)>>3;
+			if (!count) return;
+			uint64_t word=0;
+			for (uint32_t i=0;i<8;i++)
+				word=(word<<8)|bufPtr[bufOffset+i];
+			bufBitsContent=(bufBitsContent<<(count*8))|(word>>(64-count*8));
+			bufBitsLength+=count*8;
+			bufOffset+=count;
+			return;
+		}
+		while (bufBitsLength<=56 && bufOffset<packedSize)
 		{
-			if (bufOffset>=packedSize) throw Decompressor::DecompressionError();
 			bufBitsContent=(bufBitsContent<<8)|bufPtr[bufOffset++];
 			bufBitsLength+=8;
 		}
+	};
 
-		uint32_t ret=(bufBitsContent>>(bufBitsLength-bits))&((1<<bits)-1);
+	auto readBits=[&](uint32_t bits)->uint32_t
+	{
+		if (bufBitsLength<bits)
+		{
+			refill();
+			if (bufBitsLength<bits) throw Decompressor::DecompressionError();
+		}
 		bufBitsLength-=bits;
-		return ret;
+		return uint32_t(bufBitsContent>>bufBitsLength)&((1U<<bits)-1);
 	};
 	
 	auto readBit=[&]()->uint32_t
@@ -63,37 +82,75 @@ void SQSHDecompressor::decompressImpl(Buffer &rawData,const Buffer &previousData
 		return readBits(1);
 	};
 
-	auto readSignedBits=[&](uint8_t bits)->int32_t
+	// past the end of the stream the bits read as zero
+	auto peekBits=[&](uint32_t bits)->uint32_t
 	{
-		int32_t ret=readBits(bits);
-		if (ret&(1<<(bits-1)))
-			ret|=~0U<<bits;
-		return ret;
+		if (bufBitsLength<bits) refill();
+		if (bufBitsLength>=bits) return uint32_t(bufBitsContent>>(bufBitsLength-bits))&((1U<<bits)-1);
+		return uint32_t(bufBitsContent<<(bits-bufBitsLength))&((1U<<bits)-1);
 	};
 
-	HuffmanDecoder<uint8_t,0xffU,4> modDecoder
+	// the codes are short enough to be decoded with a single lookup, (value<<4)|length
+	struct Tables
 	{
-		HuffmanCode<uint8_t>{1,0b0001,0},
-		HuffmanCode<uint8_t>{2,0b0000,1},
-		HuffmanCode<uint8_t>{3,0b0010,2},
-		HuffmanCode<uint8_t>{4,0b0110,3},
-		HuffmanCode<uint8_t>{4,0b0111,4}
+		uint8_t	mod[16];
+		uint8_t	length[16];
+		uint8_t	distance[4];
 	};
 
-	HuffmanDecoder<uint8_t,0xffU,4> lengthDecoder
+	static const Tables tables=[]()->Tables
 	{
-		HuffmanCode<uint8_t>{1,0b0000,0},
-		HuffmanCode<uint8_t>{2,0b0010,1},
-		HuffmanCode<uint8_t>{3,0b0110,2},
-		HuffmanCode<uint8_t>{4,0b1110,3},
-		HuffmanCode<uint8_t>{4,0b1111,4}
-	};
+		HuffmanDecoder<uint8_t,0xffU,4> modDecoder
+		{
+			HuffmanCode<uint8_t>{1,0b0001,0},
+			HuffmanCode<uint8_t>{2,0b0000,1},
+			HuffmanCode<uint8_t>{3,0b0010,2},
+			HuffmanCode<uint8_t>{4,0b0110,3},
+			HuffmanCode<uint8_t>{4,0b0111,4}
+		};
+
+		HuffmanDecoder<uint8_t,0xffU,4> lengthDecoder
+		{
+			HuffmanCode<uint8_t>{1,0b0000,0},
+			HuffmanCode<uint8_t>{2,0b0010,1},
+			HuffmanCode<uint8_t>{3,0b0110,2},
+			HuffmanCode<uint8_t>{4,0b1110,3},
+			HuffmanCode<uint8_t>{4,0b1111,4}
+		};
+
+		HuffmanDecoder<uint8_t,0xffU,2> distanceDecoder
+		{
+			HuffmanCode<uint8_t>{1,0b01,0},
+			HuffmanCode<uint8_t>{2,0b00,1},
+			HuffmanCode<uint8_t>{2,0b01,2}
+		};
 
-	HuffmanDecoder<uint8_t,0xffU,2> distanceDecoder
+		// all the codes are complete, every index decodes to something
+		auto fill=[](auto &decoder,uint8_t *table,uint32_t depth)
+		{
+			for (uint32_t i=0;i<(1U<<depth);i++)
+			{
+				uint32_t length=0;
+				uint8_t value=decoder.decode([&]()->uint32_t
+				{
+					return (i>>(depth-1-length++))&1;
+				});
+				table[i]=(value<<4)|length;
+			}
+		};
+
+		Tables ret;
+		fill(modDecoder,ret.mod,4);
+		fill(lengthDecoder,ret.length,4);
+		fill(distanceDecoder,ret.distance,2);
+		return ret;
+	}();
+
+	auto decodeTable=[&](const uint8_t *table,uint32_t depth)->uint32_t
 	{
-		HuffmanCode<uint8_t>{1,0b01,0},
-		HuffmanCode<uint8_t>{2,0b00,1},
-		HuffmanCode<uint8_t>{2,0b01,2}
+		uint8_t entry=table[peekBits(depth)];
+		readBits(entry&15);
+		return entry>>4;
 	};
 
 	uint8_t *dest=rawData.data();
@@ -146,7 +203,7 @@ void SQSHDecompressor::decompressImpl(Buffer &rawData,const Buffer &previousData
 				handleCondCase();
 			};
 
-			uint32_t mod=modDecoder.decode(readBit);
+			uint32_t mod=decodeTable(tables.mod,4);
 			switch (mod)
 			{
 				case 0:
@@ -191,7 +248,7 @@ void SQSHDecompressor::decompressImpl(Buffer &rawData,const Buffer &previousData
 		}
 
 		if (doRepeat) {
-			uint32_t lengthIndex=lengthDecoder.decode(readBit);
+			uint32_t lengthIndex=decodeTable(tables.length,4);
 			static const uint8_t lengthBits[5]={1,1,1,3,5};
 			static const uint32_t lengthAdditions[5]={2,4,6,8,16};
 			count=readBits(lengthBits[lengthIndex])+lengthAdditions[lengthIndex];
@@ -200,23 +257,41 @@ void SQSHDecompressor::decompressImpl(Buffer &rawData,const Buffer &previousData
 				if (accum1) accum1--;
 				if (count>3 && accum1) accum1--;
 			}
-			uint32_t distanceIndex=distanceDecoder.decode(readBit);
+			uint32_t distanceIndex=decodeTable(tables.distance,2);
 			static const uint8_t distanceBits[3]={12,8,14};
 			static const uint32_t distanceAdditions[3]={0x101,1,0x1101};
 			uint32_t distance=readBits(distanceBits[distanceIndex])+distanceAdditions[distanceIndex];
 			if (destOffset+count>_rawSize)
 				count=uint32_t(_rawSize-destOffset);
 			if (distance>destOffset) throw Decompressor::DecompressionError();
-			for (uint32_t i=0;i<count;i++,destOffset++)
-				dest[destOffset]=dest[destOffset-distance];
+			LZCopyForward(dest+destOffset,distance,count);
+			destOffset+=count;
 			currentSample=dest[destOffset-1];
 		} else {
 			if (destOffset+count>_rawSize)
 				count=uint32_t(_rawSize-destOffset);
-			for (uint32_t i=0;i<count;i++)
+			// The whole run (at most 5 samples, 40 bits) is taken from the accumulator at once.
+			// When the stream ends in the middle, the samples are read one by one until the error
+			uint32_t runBits=count*bits;
+			if (bufBitsLength<runBits) refill();
+			uint8_t signBit=1U<<(bits-1);
+			if (bufBitsLength>=runBits)
 			{
-				currentSample-=readSignedBits(bits);
-				dest[destOffset++]=currentSample;
+				bufBitsLength-=runBits;
+				uint64_t run=bufBitsContent>>bufBitsLength;
+				for (uint32_t i=count;i;i--)
+				{
+					// sign extension to 8 bits is enough for 8-bit samples
+					uint8_t delta=uint8_t(run>>((i-1)*bits))&((signBit<<1)-1);
+					currentSample-=uint8_t((delta^signBit)-signBit);
+					dest[destOffset++]=currentSample;
+				}
+			} else {
+				for (uint32_t i=0;i<count;i++)
+				{
+					currentSample-=uint8_t((readBits(bits)^signBit)-signBit);
+					dest[destOffset++]=currentSample;
+				}
 			}
 			if (accum1!=31) accum1++;
 			prevBits=bits;
@@ -0,0 +1,52 @@
+/* Copyright (C) Teemu Suutari */
+
+#include <deque>
+
+#include "ScanFiles.hpp"
+#include "VectorBuffer.hpp"
+#include "LazyBuffer.hpp"
+
+uint64_t pathHash(const std::string &path) noexcept
+{
+	uint64_t ret=0xcbf2'9ce4'8422'2325ULL;
+	for (auto ch : path)
+		ret=(ret^uint8_t(ch))*0x100'0000'01b3ULL;
+	return ret;
+}
+
+void readFiles(BatchIO &io,const std::vector<DirectoryWalker::File> &files,const std::function<bool(const DirectoryWalker::File&)> &wanted,
+	const std::function<void(const DirectoryWalker::File&,const Buffer*)> &process)
+{
+	static constexpr size_t depth=32;
+	static constexpr size_t readAheadSize=0x1000'0000U;
+
+	std::deque<std::unique_ptr<Buffer>> queue;
+	size_t next=0;
+	size_t queuedSize=0;
+	for (auto &it : files)
+	{
+		while (next<files.size() && queue.size()<depth && (queue.empty() || queuedSize<readAheadSize))
+		{
+			std::unique_ptr<Buffer> buffer;
+			if (wanted(files[next]))
+			{
+				// mapping is not worth it for small files
+				if (files[next].st.st_size<0x10'0000) buffer=std::make_unique<VectorBuffer>();
+					else buffer=std::make_unique<LazyBuffer>();
+				buffer->resize(size_t(files[next].st.st_size));
+				queuedSize+=buffer->size();
+				io.queueRead(files[next].name,*buffer);
+			}
+			queue.push_back(std::move(buffer));
+			next++;
+		}
+		auto buffer=std::move(queue.front());
+		queue.pop_front();
+		if (buffer)
+		{
+			queuedSize-=buffer->size();
+			if (!io.waitRead()) buffer.reset();
+		}
+		process(it,buffer.get());
+	}
+}
@@ -0,0 +1,24 @@
+/* Copyright (C) Teemu Suutari */
+
+#ifndef SCANFILES_HPP
+#define SCANFILES_HPP
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+#include <functional>
+
+#include "Buffer.hpp"
+#include "BatchIO.hpp"
+#include "DirectoryWalker.hpp"
+
+// FNV-1a, stable between the runs and the machines for partitioning the files
+uint64_t pathHash(const std::string &path) noexcept;
+
+// Reads the files in order, keeping reads in flight ahead of the processing (max depth files or readAheadSize bytes).
+// Only the wanted files are read, process gets nullptr for the others and for the failed reads
+void readFiles(BatchIO &io,const std::vector<DirectoryWalker::File> &files,const std::function<bool(const DirectoryWalker::File&)> &wanted,
+	const std::function<void(const DirectoryWalker::File&,const Buffer*)> &process);
+
+#endif
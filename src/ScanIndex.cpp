@@ -0,0 +1,181 @@
+/* Copyright (C) Teemu Suutari */
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <fstream>
+
+#include "ScanIndex.hpp"
+#include "Span.hpp"
+
+uint64_t contentHash(const Buffer &buffer) noexcept
+{
+	static constexpr uint64_t prime=0x9e37'79b9'7f4a'7c15ULL;
+	ConstSpan data(buffer);
+	uint64_t ret=data.size()*prime;
+	size_t i=0;
+	for (;i+8<=data.size();i+=8)
+	{
+		ret=(ret^data.readLE64Unchecked(i))*prime;
+		ret^=ret>>29;
+	}
+	for (;i<data.size();i++)
+		ret=(ret^data.read8Unchecked(i))*prime;
+	return ret^(ret>>32);
+}
+
+static std::string formatDigest(const SHA256Digest &digest)
+{
+	static const char hexDigits[]="0123456789abcdef";
+	std::string ret;
+	for (auto it : digest)
+	{
+		ret+=hexDigits[it>>4];
+		ret+=hexDigits[it&15];
+	}
+	return ret;
+}
+
+static bool parseDigest(const char *str,SHA256Digest &digest) noexcept
+{
+	auto nibble=[](char ch)->int
+	{
+		if (ch>='0' && ch<='9') return ch-'0';
+		if (ch>='a' && ch<='f') return ch-'a'+10;
+		return -1;
+	};
+	for (uint32_t i=0;i<32;i++)
+	{
+		int high=nibble(str[i*2]);
+		int low=(high>=0)?nibble(str[i*2+1]):-1;
+		if (low<0) return false;
+		digest[i]=uint8_t((high<<4)|low);
+	}
+	return !str[64];
+}
+
+
+static const char *scanIndexHeader="ancient scan index 4";
+static const char *scanIndexHeaderV3="ancient scan index 3";
+static const char *scanIndexHeaderV2="ancient scan index 2";
+static const char *scanIndexHeaderV1="ancient scan index 1";
+
+ScanIndex::ScanIndex(const std::string &fileName) :
+	_fileName(fileName)
+{
+	std::ifstream file(fileName.c_str(),std::ios::in);
+	std::string line;
+	if (file.is_open() && std::getline(file,line) && (line==scanIndexHeader || line==scanIndexHeaderV3 || line==scanIndexHeaderV2 || line==scanIndexHeaderV1))
+	{
+		bool isV1=line==scanIndexHeaderV1;
+		bool isV2=line==scanIndexHeaderV2;
+		bool isV3=line==scanIndexHeaderV3;
+		// truncated record at the end (interrupted write) is simply dropped
+		while (std::getline(file,line))
+		{
+			unsigned long long size,hash;
+			long long mtime;
+			unsigned long recursion=0,count;
+			int pathPos=0;
+			if (isV1)
+			{
+				if (sscanf(line.c_str(),"F %llu %lld %llx %lu %n",&size,&mtime,&hash,&count,&pathPos)!=4 || !pathPos) break;
+			} else {
+				if (sscanf(line.c_str(),"F %llu %lld %llx %lu %lu %n",&size,&mtime,&hash,&recursion,&count,&pathPos)!=5 || !pathPos) break;
+			}
+			Entry entry{size,mtime,hash,uint32_t(recursion),{}};
+			std::string path=line.substr(pathPos);
+			while (entry.streams.size()<count && std::getline(file,line))
+			{
+				unsigned long long offset,packedSize,rawSize=0;
+				unsigned long fileIndex,parent=0;
+				// "-" when the stream came from an old index
+				char streamHash[65]="-";
+				int namePos=0;
+				if (isV1)
+				{
+					if (sscanf(line.c_str(),"S %llu %llu %lu %n",&offset,&packedSize,&fileIndex,&namePos)!=3 || !namePos) break;
+				} else if (isV2) {
+					if (sscanf(line.c_str(),"S %llu %llu %lu %lu %n",&offset,&packedSize,&fileIndex,&parent,&namePos)!=4 || !namePos) break;
+				} else {
+					if (sscanf(line.c_str(),"S %llu %llu %llu %64s %lu %lu %n",&offset,&packedSize,&rawSize,streamHash,&fileIndex,&parent,&namePos)!=6 || !namePos) break;
+					// too weak for telling the streams apart
+					if (isV3) streamHash[0]='-';
+				}
+				// containers are always before the streams they contain
+				if (parent>entry.streams.size()) break;
+				Stream stream{size_t(offset),size_t(packedSize),size_t(rawSize),false,{},uint32_t(fileIndex),uint32_t(parent),line.substr(namePos)};
+				stream.hasHash=streamHash[0]!='-';
+				if (stream.hasHash && !parseDigest(streamHash,stream.hash)) break;
+				entry.streams.push_back(std::move(stream));
+				_nextFileIndex=std::max(_nextFileIndex,uint32_t(fileIndex)+1);
+			}
+			if (entry.streams.size()!=count) break;
+			_entries[path]=std::move(entry);
+		}
+		file.close();
+		// whatever was after the last complete record needs to go
+		compact();
+	} else {
+		file.close();
+		_file=::fopen(fileName.c_str(),"w");
+		if (_file)
+		{
+			fprintf(_file,"%s\n",scanIndexHeader);
+			::fflush(_file);
+		}
+	}
+	if (!_file) fprintf(stderr,"Could not write scan index %s\n",fileName.c_str());
+}
+
+ScanIndex::~ScanIndex()
+{
+	if (_file) ::fclose(_file);
+}
+
+const ScanIndex::Entry *ScanIndex::find(const std::string &path) const
+{
+	auto it=_entries.find(path);
+	return (it!=_entries.end())?&it->second:nullptr;
+}
+
+void ScanIndex::add(const std::string &path,const Entry &entry)
+{
+	// line based format
+	if (path.find('\n')!=std::string::npos) return;
+	_entries[path]=entry;
+	for (auto &it : entry.streams)
+		_nextFileIndex=std::max(_nextFileIndex,it.fileIndex+1);
+	if (_file)
+	{
+		write(_file,path,entry);
+		::fflush(_file);
+	}
+}
+
+void ScanIndex::compact()
+{
+	if (_file) ::fclose(_file);
+	_file=nullptr;
+	std::string tmpName=_fileName+".tmp";
+	FILE *file=::fopen(tmpName.c_str(),"w");
+	if (!file) return;
+	fprintf(file,"%s\n",scanIndexHeader);
+	for (auto &it : _entries)
+		write(file,it.first,it.second);
+	bool success=!::ferror(file);
+	success&=!::fclose(file);
+	if (success && !::rename(tmpName.c_str(),_fileName.c_str()))
+		_file=::fopen(_fileName.c_str(),"a");
+}
+
+void ScanIndex::write(FILE *file,const std::string &path,const Entry &entry)
+{
+	fprintf(file,"F %llu %lld %llx %u %zu %s\n",(unsigned long long)entry.size,(long long)entry.mtime,(unsigned long long)entry.hash,entry.recursion,entry.streams.size(),path.c_str());
+	for (auto &it : entry.streams)
+	{
+		// streams from an old index are written without the hash
+		if (it.hasHash) fprintf(file,"S %zu %zu %zu %s %u %u %s\n",it.offset,it.packedSize,it.rawSize,formatDigest(it.hash).c_str(),it.fileIndex,it.parent,it.name.c_str());
+			else fprintf(file,"S %zu %zu %zu - %u %u %s\n",it.offset,it.packedSize,it.rawSize,it.fileIndex,it.parent,it.name.c_str());
+	}
+}
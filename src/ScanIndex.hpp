@@ -0,0 +1,75 @@
+/* Copyright (C) Teemu Suutari */
+
+#ifndef SCANINDEX_HPP
+#define SCANINDEX_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Buffer.hpp"
+#include "SHA256.hpp"
+
+// Index of the scanned files, stored into the output directory of scan.
+// Each file is appended as a record once it has been completely scanned, thus an interrupted scan
+// can be resumed and unchanged files can be replayed from the index instead of scanning them again.
+// Text format, later records override earlier ones for the same path:
+//   F <size> <mtime> <hash> <recursion depth> <stream count> <path>
+//   S <offset> <packed size> <raw size> <SHA-256 or -> <output file index> <container> <format name>	(stream count times)
+// Container is 0 for streams in the file itself, otherwise the number of the stream
+// (starting from 1) in whose decompressed data the stream was found. The SHA-256 of the stream lets
+// the new files refer to the stored streams of the replayed files.
+// Version 1 index (without the recursion depth and the containers), version 2 index (without the raw sizes
+// and the hashes of the streams) and version 3 index (with 64-bit hashes that are ignored) are still read
+class ScanIndex
+{
+public:
+	struct Stream
+	{
+		size_t		offset;
+		size_t		packedSize;
+		size_t		rawSize;
+		bool		hasHash;	// false for the streams from an old index
+		SHA256Digest	hash;
+		uint32_t	fileIndex;
+		uint32_t	parent;
+		std::string	name;
+	};
+
+	struct Entry
+	{
+		uint64_t		size;
+		int64_t			mtime;
+		uint64_t		hash;
+		uint32_t		recursion;
+		std::vector<Stream>	streams;
+	};
+
+	ScanIndex(const std::string &fileName);
+	~ScanIndex();
+
+	const Entry *find(const std::string &path) const;
+	// record is written to the disk immediately
+	void add(const std::string &path,const Entry &entry);
+	// rewrites the index with only the latest records
+	void compact();
+
+	uint32_t getNextFileIndex() const noexcept { return _nextFileIndex; }
+
+private:
+	void write(FILE *file,const std::string &path,const Entry &entry);
+
+	std::string			_fileName;
+	std::map<std::string,Entry>	_entries;
+	FILE				*_file=nullptr;
+	uint32_t			_nextFileIndex=0;
+};
+
+// Simple multiply-rotate hash over 64-bit words. Not cryptographic, only for noticing changed files
+uint64_t contentHash(const Buffer &buffer) noexcept;
+
+#endif
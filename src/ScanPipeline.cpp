@@ -0,0 +1,281 @@
+/* Copyright (C) Teemu Suutari */
+
+#include "ScanPipeline.hpp"
+#include "Decompressor.hpp"
+#include "SubBuffer.hpp"
+#include "CRC32.hpp"
+#include "VectorBuffer.hpp"
+#include "LazyBuffer.hpp"
+
+// Finds the compressed streams in a buffer. For each stream found, the callback is called with
+// the offset, the stream itself, its decompressor and the decompressed data if the stream had to be
+// decompressed (nullptr if it was only measured). The callback can take the decompressed data.
+// When needRaw is set, all the streams are decompressed.
+// Before the final checks, seen is called with the stream once its size is known. If it returns true
+// (the content has been found before), the stream is skipped without decompressing it
+typedef std::function<bool(size_t,const Buffer&,const Decompressor&)> SeenCallback;
+typedef std::function<void(size_t,const Buffer&,const Decompressor&,std::unique_ptr<Buffer>&)> StreamCallback;
+
+static void findStreams(const Buffer &packed,bool needRaw,const SeenCallback &seen,const StreamCallback &found)
+{
+	ConstSubBuffer scanBuffer(packed,0,packed.size());
+	for (size_t i=0;i<packed.size();)
+	{
+		scanBuffer.adjust(i,packed.size()-i);
+		// We will probe first, before trying the format for real.
+		// This filters out most of the false positives without creating a decompressor
+		if (!Decompressor::probe(scanBuffer,false))
+		{
+			i++;
+			continue;
+		}
+		try
+		{
+			auto decompressor{Decompressor::create(scanBuffer,false,true)};
+			std::unique_ptr<Buffer> raw;
+			// for formats that do not encode packed size.
+			// we will get it from decompressor, preferably by measuring the stream without output.
+			// If that is not supported, the stream is decompressed and no further checks are needed.
+			// Measuring does not verify the checksums of the raw data, thus the final checks are still done
+			// for the streams that are not duplicates
+			bool checked=false;
+			if (!decompressor->getPackedSize())
+			{
+				if (!decompressor->measure())
+				{
+					raw=std::make_unique<LazyBuffer>();
+					raw->resize((decompressor->getRawSize())?decompressor->getRawSize():Decompressor::getMaxRawSize());
+					decompressor->decompress(*raw,true);
+					checked=true;
+				}
+			}
+			if (decompressor->getPackedSize())
+			{
+				ConstSubBuffer finalBuffer(packed,i,decompressor->getPackedSize());
+				if (seen(i,finalBuffer,*decompressor))
+				{
+					i+=finalBuffer.size();
+					continue;
+				}
+				if (!checked || (needRaw && !raw))
+				{
+					// final checks with the limited buffer and fresh decompressor
+					auto decompressor2{Decompressor::create(finalBuffer,true,true)};
+					raw=std::make_unique<LazyBuffer>();
+					raw->resize((decompressor2->getRawSize())?decompressor2->getRawSize():Decompressor::getMaxRawSize());
+					decompressor2->decompress(*raw,true);
+					decompressor=std::move(decompressor2);
+				}
+				if (raw) raw->resize(decompressor->getRawSize());
+				found(i,finalBuffer,*decompressor,raw);
+				i+=finalBuffer.size();
+				continue;
+			}
+		} catch (const Decompressor::Error&) {
+			// full steam ahead (with next offset)
+		}
+		i++;
+	}
+}
+
+
+SeenStreams::Record *SeenStreams::find(size_t size,const SHA256Digest &hash,uint64_t job)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	auto it=_records.find(std::make_pair(size,hash));
+	return (it!=_records.end() && it->second.owner<=job)?&it->second:nullptr;
+}
+
+SeenStreams::Record *SeenStreams::claim(size_t size,const SHA256Digest &hash,uint64_t job,const Record &record)
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	auto key=std::make_pair(size,hash);
+	auto it=_records.find(key);
+	if (it==_records.end())
+	{
+		if (_records.size()>=maxEntries) return nullptr;
+		it=_records.emplace(key,record).first;
+		it->second.owner=job;
+	} else if (job<it->second.owner) {
+		// found from an earlier job by the recursive scan
+		it->second.owner=job;
+	}
+	return &it->second;
+}
+
+bool SeenStreams::isOwner(const Record &record,uint64_t job) const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	return record.owner==job;
+}
+
+ScanPipeline::ScanPipeline(uint32_t depth,bool copyStreams,bool calculateCRC,const std::function<void(ScanJob&)> &output) :
+	_depth(depth),
+	_copyStreams(copyStreams),
+	_calculateCRC(calculateCRC),
+	_output(output)
+{
+	if (_depth) _worker=std::thread([this]() { worker(); });
+}
+
+ScanPipeline::~ScanPipeline()
+{
+	if (_worker.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_finished=true;
+		}
+		_condition.notify_all();
+		_worker.join();
+	}
+}
+
+std::unique_ptr<ScanJob> ScanPipeline::createJob(const std::string &path)
+{
+	auto ret=std::make_unique<ScanJob>();
+	ret->sequence=_nextSequence++;
+	ret->path=path;
+	ret->replay=false;
+	return ret;
+}
+
+void ScanPipeline::scan(ScanJob &job,const Buffer &packed)
+{
+	scan(packed,job.sequence,0,0,job.streams);
+}
+
+void ScanPipeline::remember(const ScanJob &job)
+{
+	for (auto &it : job.entry.streams)
+		if (it.hasHash) _seen.claim(it.packedSize,it.hash,job.sequence,SeenStreams::Record{it.rawSize,false,0,it.name,job.sequence,it.fileIndex});
+}
+
+// Streams found are appended, each one followed by the streams inside it. At the top level (depth 0)
+// the decompressed data is kept for the worker, below that it is scanned right away
+void ScanPipeline::scan(const Buffer &packed,uint64_t job,uint32_t parent,uint32_t depth,std::vector<FoundStream> &streams)
+{
+	bool needRaw=depth<_depth;
+	std::pair<size_t,SHA256Digest> key;
+	auto seen=[&](size_t offset,const Buffer &stream,const Decompressor&)->bool
+	{
+		// one hash for the repeated content
+		key=std::make_pair(stream.size(),SHA256(stream,0,stream.size()));
+		SeenStreams::Record *record=_seen.find(key.first,key.second,job);
+		if (!record) return false;
+		streams.push_back(FoundStream{offset,stream.size(),key.second,record->rawSize,record->hasRawCRC,record->rawCRC,parent,record->name,nullptr,nullptr,record,true});
+		return true;
+	};
+	findStreams(packed,needRaw,seen,[&](size_t offset,const Buffer &stream,const Decompressor &decompressor,std::unique_ptr<Buffer> &raw)
+	{
+		FoundStream found{offset,stream.size(),key.second,decompressor.getRawSize(),false,0,parent,decompressor.getName(),nullptr,nullptr,nullptr,false};
+		if (_calculateCRC && raw && raw->size())
+		{
+			found.hasRawCRC=true;
+			found.rawCRC=CRC32(*raw,0,raw->size(),0);
+		}
+		if (_copyStreams)
+		{
+			found.packed=std::make_unique<VectorBuffer>();
+			found.packed->resize(stream.size());
+			::memcpy(found.packed->data(),stream.data(),stream.size());
+		}
+		found.record=_seen.claim(key.first,key.second,job,SeenStreams::Record{found.rawSize,found.hasRawCRC,found.rawCRC,found.name,job,~0U});
+		streams.push_back(std::move(found));
+		if (!needRaw || !raw || !raw->size()) return;
+		if (!depth)
+		{
+			streams.back().raw=std::move(raw);
+		} else {
+			auto data=std::move(raw);
+			scan(*data,job,uint32_t(streams.size()),depth+1,streams);
+		}
+	});
+}
+
+void ScanPipeline::worker()
+{
+	std::unique_lock<std::mutex> lock(_mutex);
+	for (;;)
+	{
+		_condition.wait(lock,[&]() { return !_queue.empty() || _finished; });
+		if (_queue.empty()) break;
+		auto job=std::move(_queue.front().first);
+		size_t size=_queue.front().second;
+		_queue.pop_front();
+		lock.unlock();
+
+		std::vector<FoundStream> streams;
+		for (auto &it : job->streams)
+		{
+			auto raw=std::move(it.raw);
+			if (!it.duplicate && it.record && !_seen.isOwner(*it.record,job->sequence))
+			{
+				it.duplicate=true;
+				it.packed.reset();
+				raw.reset();
+			}
+			streams.push_back(std::move(it));
+			try
+			{
+				if (raw) scan(*raw,job->sequence,uint32_t(streams.size()),1,streams);
+			} catch (const std::bad_alloc&) {
+				// the streams found so far are still good
+			}
+		}
+		job->streams=std::move(streams);
+
+		lock.lock();
+		_completed.push_back(std::move(job));
+		_queuedSize-=size;
+		_pending--;
+		_condition.notify_all();
+	}
+}
+
+void ScanPipeline::outputCompleted(std::unique_lock<std::mutex> &lock)
+{
+	while (!_completed.empty())
+	{
+		auto job=std::move(_completed.front());
+		_completed.pop_front();
+		lock.unlock();
+		_output(*job);
+		lock.lock();
+	}
+}
+
+void ScanPipeline::push(std::unique_ptr<ScanJob> job)
+{
+	if (!_depth)
+	{
+		_output(*job);
+		return;
+	}
+	size_t size=0;
+	for (auto &it : job->streams)
+		if (it.raw) size+=it.raw->size();
+	std::unique_lock<std::mutex> lock(_mutex);
+	for (;;)
+	{
+		outputCompleted(lock);
+		if (!_queuedSize || _queuedSize+size<=maxQueuedSize) break;
+		_condition.wait(lock);
+	}
+	_queue.emplace_back(std::move(job),size);
+	_queuedSize+=size;
+	_pending++;
+	_condition.notify_all();
+}
+
+void ScanPipeline::finish()
+{
+	if (!_depth) return;
+	std::unique_lock<std::mutex> lock(_mutex);
+	for (;;)
+	{
+		outputCompleted(lock);
+		if (!_pending) break;
+		_condition.wait(lock);
+	}
+}
@@ -0,0 +1,156 @@
+/* Copyright (C) Teemu Suutari */
+
+#ifndef SCANPIPELINE_HPP
+#define SCANPIPELINE_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+#include "Buffer.hpp"
+#include "SHA256.hpp"
+#include "ScanIndex.hpp"
+
+// Packed contents of the streams found so far, shared by the scan threads. Streams with identical
+// content are decompressed and stored only once, the content is identified by its size and SHA-256.
+// The owner of the content is the earliest job (in the output order) where it has been found,
+// the copies in the later jobs refer to it. Memory is bounded by maxEntries, after that
+// new contents are not remembered anymore
+class SeenStreams
+{
+public:
+	struct Record
+	{
+		size_t		rawSize;
+		bool		hasRawCRC;
+		uint32_t	rawCRC;
+		std::string	name;
+		uint64_t	owner;
+		uint32_t	fileIndex;	// set by the output when the owner has been stored, known for replayed files
+	};
+
+	SeenStreams()=default;
+	~SeenStreams()=default;
+
+	// returns the record if the content was found in the job or before it
+	Record *find(size_t size,const SHA256Digest &hash,uint64_t job);
+	// returns nullptr if the content can't be remembered
+	Record *claim(size_t size,const SHA256Digest &hash,uint64_t job,const Record &record);
+	bool isOwner(const Record &record,uint64_t job) const;
+
+private:
+	static constexpr size_t maxEntries=0x10'0000U;
+
+	using Key=std::pair<size_t,SHA256Digest>;
+
+	// the digest is uniformly distributed already
+	struct KeyHash
+	{
+		size_t operator()(const Key &key) const noexcept
+		{
+			size_t ret;
+			::memcpy(&ret,key.second.data(),sizeof(ret));
+			return ret^key.first;
+		}
+	};
+
+	mutable std::mutex				_mutex;
+	std::unordered_map<Key,Record,KeyHash>		_records;
+};
+
+// Streams found in a single file. With recursive scan, the streams found in the decompressed data
+// follow their container
+struct FoundStream
+{
+	size_t			offset;
+	size_t			packedSize;
+	SHA256Digest		hash;		// of the packed stream
+	size_t			rawSize;
+	bool			hasRawCRC;
+	uint32_t		rawCRC;
+	uint32_t		parent;		// 0 for the file itself, otherwise the container stream index + 1
+	std::string		name;
+	std::unique_ptr<Buffer>	packed;		// copy of the stream, if it is to be stored
+	std::unique_ptr<Buffer>	raw;		// decompressed data, until it has been scanned
+	SeenStreams::Record	*record;	// nullptr if not remembered
+	bool			duplicate;	// content is owned by another stream
+};
+
+struct ScanJob
+{
+	uint64_t			sequence;
+	std::string			path;
+	ScanIndex::Entry		entry;
+	bool				replay;		// streams are in the entry, nothing was scanned
+	std::vector<FoundStream>	streams;
+};
+
+// Describes where a stream is, e.g. "stream at 123 in file foo"
+template<typename T>
+std::string streamContainer(const std::string &path,const std::vector<T> &streams,uint32_t parent)
+{
+	std::string ret;
+	for (;parent;parent=streams[parent-1].parent)
+		ret+="stream at "+std::to_string(streams[parent-1].offset)+" in ";
+	return ret+"file "+path;
+}
+
+// Recursive scan is a pipeline stage: while the main thread reads and scans the next files, a worker
+// thread scans the decompressed data of the streams found earlier, up to depth levels. Nothing is written
+// to the disk in between. Jobs are output in the order they were pushed, always from the thread calling push
+// or finish. The decompressed data waiting to be scanned is limited to maxQueuedSize, push blocks until there is room.
+// With depth 0 the jobs are output directly.
+// Duplicate contents are not decompressed again. The worker decides the final owners of the top level
+// streams, since it might have found the same content from an earlier job meanwhile
+class ScanPipeline
+{
+public:
+	ScanPipeline(uint32_t depth,bool copyStreams,bool calculateCRC,const std::function<void(ScanJob&)> &output);
+	~ScanPipeline();
+
+	std::unique_ptr<ScanJob> createJob(const std::string &path);
+	// finds the top level streams
+	void scan(ScanJob &job,const Buffer &packed);
+	// streams of a replayed job are stored already, the later jobs can refer to them
+	void remember(const ScanJob &job);
+	void push(std::unique_ptr<ScanJob> job);
+	// outputs all remaining jobs
+	void finish();
+
+	uint32_t getDepth() const noexcept { return _depth; }
+
+private:
+	static constexpr size_t maxQueuedSize=0x1000'0000U;
+
+	void scan(const Buffer &packed,uint64_t job,uint32_t parent,uint32_t depth,std::vector<FoundStream> &streams);
+	void worker();
+	void outputCompleted(std::unique_lock<std::mutex> &lock);
+
+	uint32_t					_depth;
+	bool						_copyStreams;
+	bool						_calculateCRC;
+	std::function<void(ScanJob&)>			_output;
+	SeenStreams					_seen;
+	uint64_t					_nextSequence=0;
+
+	std::mutex					_mutex;
+	std::condition_variable				_condition;
+	std::deque<std::pair<std::unique_ptr<ScanJob>,size_t>>	_queue;
+	std::deque<std::unique_ptr<ScanJob>>		_completed;
+	size_t						_queuedSize=0;
+	size_t						_pending=0;
+	bool						_finished=false;
+	std::thread					_worker;
+};
+
+#endif
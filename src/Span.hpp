@@ -0,0 +1,181 @@
+/* Copyright (C) Teemu Suutari */
+
+#ifndef SPAN_HPP
+#define SPAN_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "Buffer.hpp"
+
+// Unaligned loads from memory. Compile into a single load (+byteswap)
+inline uint16_t loadBE16(const uint8_t *ptr) noexcept
+{
+	uint16_t ret;
+	::memcpy(&ret,ptr,2);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__==__ORDER_LITTLE_ENDIAN__
+	return __builtin_bswap16(ret);
+#elif defined(__BYTE_ORDER__) && __BYTE_ORDER__==__ORDER_BIG_ENDIAN__
+	return ret;
+#else
+	return (uint16_t(ptr[0])<<8)|uint16_t(ptr[1]);
+#endif
+}
+
+inline uint32_t loadBE32(const uint8_t *ptr) noexcept
+{
+	uint32_t ret;
+	::memcpy(&ret,ptr,4);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__==__ORDER_LITTLE_ENDIAN__
+	return __builtin_bswap32(ret);
+#elif defined(__BYTE_ORDER__) && __BYTE_ORDER__==__ORDER_BIG_ENDIAN__
+	return ret;
+#else
+	return (uint32_t(ptr[0])<<24)|(uint32_t(ptr[1])<<16)|(uint32_t(ptr[2])<<8)|uint32_t(ptr[3]);
+#endif
+}
+
+inline uint16_t loadLE16(const uint8_t *ptr) noexcept
+{
+	uint16_t ret;
+	::memcpy(&ret,ptr,2);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__==__ORDER_LITTLE_ENDIAN__
+	return ret;
+#elif defined(__BYTE_ORDER__) && __BYTE_ORDER__==__ORDER_BIG_ENDIAN__
+	return __builtin_bswap16(ret);
+#else
+	return (uint16_t(ptr[1])<<8)|uint16_t(ptr[0]);
+#endif
+}
+
+inline uint32_t loadLE32(const uint8_t *ptr) noexcept
+{
+	uint32_t ret;
+	::memcpy(&ret,ptr,4);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__==__ORDER_LITTLE_ENDIAN__
+	return ret;
+#elif defined(__BYTE_ORDER__) && __BYTE_ORDER__==__ORDER_BIG_ENDIAN__
+	return __builtin_bswap32(ret);
+#else
+	return (uint32_t(ptr[3])<<24)|(uint32_t(ptr[2])<<16)|(uint32_t(ptr[1])<<8)|uint32_t(ptr[0]);
+#endif
+}
+
+inline uint64_t loadLE64(const uint8_t *ptr) noexcept
+{
+	return uint64_t(loadLE32(ptr))|(uint64_t(loadLE32(ptr+4))<<32);
+}
+
+// Non-virtual view into the contents of a Buffer (or part of it).
+// The pointer and the size are resolved once when the span is created, thus it is cheap to use
+// in the decoders (instead of going through the virtual Buffer methods for every access).
+// The span is only valid as long as the underlying buffer is not resized or destroyed.
+// Checked reads throw Buffer::OutOfBoundsError like their Buffer counterparts,
+// Unchecked variants leave the bounds checking to the caller.
+template<typename T>
+class GenericSpan
+{
+public:
+	GenericSpan() noexcept :
+		_data(nullptr),
+		_size(0)
+	{
+		// nothing needed
+	}
+
+	GenericSpan(T *data,size_t size) noexcept :
+		_data(data),
+		_size(size)
+	{
+		// nothing needed
+	}
+
+	template<typename B>
+	explicit GenericSpan(B &buffer) :
+		_data(buffer.data()),
+		_size(buffer.size())
+	{
+		// nothing needed
+	}
+
+	template<typename U>
+	GenericSpan(const GenericSpan<U> &span) noexcept :
+		_data(span.data()),
+		_size(span.size())
+	{
+		// nothing needed
+	}
+
+	T *data() const noexcept { return _data; }
+	size_t size() const noexcept { return _size; }
+
+	T &operator[](size_t i) const
+	{
+		if (i>=_size) throw Buffer::OutOfBoundsError();
+		return _data[i];
+	}
+
+	GenericSpan subSpan(size_t start,size_t length) const
+	{
+		if (start>_size || length>_size-start) throw Buffer::OutOfBoundsError();
+		return GenericSpan(_data+start,length);
+	}
+
+	uint32_t readBE32(size_t offset) const
+	{
+		checkRange(offset,4);
+		return loadBE32(_data+offset);
+	}
+
+	uint16_t readBE16(size_t offset) const
+	{
+		checkRange(offset,2);
+		return loadBE16(_data+offset);
+	}
+
+	uint64_t readLE64(size_t offset) const
+	{
+		checkRange(offset,8);
+		return loadLE64(_data+offset);
+	}
+
+	uint32_t readLE32(size_t offset) const
+	{
+		checkRange(offset,4);
+		return loadLE32(_data+offset);
+	}
+
+	uint16_t readLE16(size_t offset) const
+	{
+		checkRange(offset,2);
+		return loadLE16(_data+offset);
+	}
+
+	uint8_t read8(size_t offset) const
+	{
+		checkRange(offset,1);
+		return _data[offset];
+	}
+
+	uint32_t readBE32Unchecked(size_t offset) const noexcept { return loadBE32(_data+offset); }
+	uint16_t readBE16Unchecked(size_t offset) const noexcept { return loadBE16(_data+offset); }
+	uint64_t readLE64Unchecked(size_t offset) const noexcept { return loadLE64(_data+offset); }
+	uint32_t readLE32Unchecked(size_t offset) const noexcept { return loadLE32(_data+offset); }
+	uint16_t readLE16Unchecked(size_t offset) const noexcept { return loadLE16(_data+offset); }
+	uint8_t read8Unchecked(size_t offset) const noexcept { return _data[offset]; }
+
+private:
+	void checkRange(size_t offset,size_t length) const
+	{
+		if (offset>_size || length>_size-offset) throw Buffer::OutOfBoundsError();
+	}
+
+	T	*_data;
+	size_t	_size;
+};
+
+typedef GenericSpan<uint8_t> Span;
+typedef GenericSpan<const uint8_t> ConstSpan;
+
+#endif
@@ -1,6 +1,8 @@
 /* Copyright (C) Teemu Suutari */
 
 #include "TDCSDecompressor.hpp"
+#include "FlagLZDecoder.hpp"
+#include "Span.hpp"
 
 bool TDCSDecompressor::detectHeaderXPK(uint32_t hdr) noexcept
 {
@@ -30,83 +32,51 @@ const std::string &TDCSDecompressor::getSubName() const noexcept
 	return name;
 }
 
-void TDCSDecompressor::decompressImpl(Buffer &rawData,const Buffer &previousData,bool verify)
+struct TDCSPolicy
 {
-	// Stream reading
-	size_t packedSize=_packedData.size();
-	const uint8_t *bufPtr=_packedData.data();
-
-	size_t bufOffset=0;
-	uint32_t bufBitsContent=0;
-	uint8_t bufBitsLength=0;
+	static constexpr uint32_t wordBits=32;
+	static constexpr uint32_t tokenBits=2;
 
-	auto read2Bits=[&]()->uint8_t
+	static uint32_t readWord(FlagLZStream &stream)
 	{
-		if (!bufBitsLength)
-		{
-			if (bufOffset+4>packedSize) throw Decompressor::DecompressionError();
-			for (uint32_t i=0;i<4;i++) bufBitsContent=uint32_t(bufPtr[bufOffset++])|(bufBitsContent<<8);
-			bufBitsLength=32;
-		}
-		uint8_t ret=bufBitsContent>>30;
-		bufBitsContent<<=2;
-		bufBitsLength-=2;
+		if (stream.offset+4>stream.end) throw Decompressor::DecompressionError();
+		uint32_t ret=loadBE32(stream.ptr+stream.offset);
+		stream.offset+=4;
 		return ret;
-	};
-
-	auto readByte=[&]()->uint8_t
-	{
-		if (bufOffset>=packedSize) throw Decompressor::DecompressionError();
-		return bufPtr[bufOffset++];
-	};
-
-	uint8_t *dest=rawData.data();
-	size_t rawSize=rawData.size();
-	size_t destOffset=0;
+	}
 
-	while (destOffset!=rawSize)
+	static void decodeToken(FlagLZStream &stream,uint32_t token)
 	{
-		uint32_t distance=0;
-		uint32_t count=0;
-		uint32_t tmp;
-		switch (read2Bits())
+		uint32_t distance,count;
+		uint32_t tmp=uint32_t(stream.readByte())<<8;
+		tmp|=uint32_t(stream.readByte());
+		switch (token)
 		{
-			case 0:
-			dest[destOffset++]=readByte();
-			break;
-
 			case 1:
-			tmp=uint32_t(readByte())<<8;
-			tmp|=uint32_t(readByte());
 			count=(tmp&3)+3;
 			distance=((tmp>>2)^0x3fff)+1;
 			break;
 
 			case 2:
-			tmp=uint32_t(readByte())<<8;
-			tmp|=uint32_t(readByte());
 			count=(tmp&0xf)+3;
 			distance=((tmp>>4)^0xfff)+1;
 			break;
 
-			case 3:
-			distance=uint32_t(readByte())<<8;
-			distance|=uint32_t(readByte());
-			count=uint32_t(readByte())+3;
-			if (!distance) throw Decompressor::DecompressionError();
-			distance=(distance^0xffff)+1;
-			break;
-			
 			default:
-			throw Decompressor::DecompressionError();
-		}
-		if (count && distance)
-		{
-			if (distance>destOffset || destOffset+count>rawSize) throw Decompressor::DecompressionError();
-			for (uint32_t i=0;i<count;i++,destOffset++)
-				dest[destOffset]=dest[destOffset-distance];
+			count=uint32_t(stream.readByte())+3;
+			if (!tmp) throw Decompressor::DecompressionError();
+			distance=(tmp^0xffff)+1;
+			break;
 		}
+		if (distance>stream.destOffset || stream.destOffset+count>stream.rawSize) throw Decompressor::DecompressionError();
+		stream.copy(distance,count);
 	}
+};
+
+void TDCSDecompressor::decompressImpl(Buffer &rawData,const Buffer &previousData,bool verify)
+{
+	FlagLZStream stream{_packedData.data(),0,_packedData.size(),rawData.data(),0,rawData.size()};
+	FlagLZDecode<TDCSPolicy>(stream);
 }
 
 XPKDecompressor::Registry<TDCSDecompressor> TDCSDecompressor::_XPKregistration;
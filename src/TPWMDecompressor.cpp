@@ -1,12 +1,23 @@
 /* Copyright (C) Teemu Suutari */
 
 #include "TPWMDecompressor.hpp"
+#include "FlagLZDecoder.hpp"
+#include "Span.hpp"
 
 bool TPWMDecompressor::detectHeader(uint32_t hdr) noexcept
 {
 	return hdr==FourCC('TPWM');
 }
 
+bool TPWMDecompressor::probe(const Buffer &packedData,bool exactSizeKnown) noexcept
+{
+	ConstSpan packed(packedData);
+	if (packed.size()<12) return false;
+	uint32_t rawSize=packed.readBE32Unchecked(4);
+	// stream can not start with a match
+	return rawSize && rawSize<=getMaxRawSize() && !(packed.read8Unchecked(8)&0x80);
+}
+
 std::unique_ptr<Decompressor> TPWMDecompressor::create(const Buffer &packedData,bool exactSizeKnown,bool verify)
 {
 	return std::make_unique<TPWMDecompressor>(packedData,verify);
@@ -49,59 +60,45 @@ size_t TPWMDecompressor::getRawSize() const noexcept
 void TPWMDecompressor::decompressImpl(Buffer &rawData,bool verify)
 {
 	if (rawData.size()<_rawSize) throw DecompressionError();
+	decodeStream<false>(rawData.data());
+}
+
+bool TPWMDecompressor::measureImpl()
+{
+	decodeStream<true>(nullptr);
+	return true;
+}
 
-	// Stream reading
-	const uint8_t *bufPtr=_packedData.data();
-	size_t bufOffset=8;
-	size_t packedSize=_packedData.size();
-	uint8_t bufBitsContent=0;
-	uint8_t bufBitsLength=0;
+template<bool measure>
+struct TPWMPolicy
+{
+	static constexpr uint32_t wordBits=8;
+	static constexpr uint32_t tokenBits=1;
 
-	auto readBit=[&]()->uint8_t
-	{
-		uint8_t ret=0;
-		if (!bufBitsLength)
-		{
-			if (bufOffset>=packedSize) throw DecompressionError();
-			bufBitsContent=bufPtr[bufOffset++];
-			bufBitsLength=8;
-		}
-		ret=bufBitsContent>>7;
-		bufBitsContent<<=1;
-		bufBitsLength--;
-		return ret;
-	};
-
-	auto readByte=[&]()->uint8_t
+	static uint32_t readWord(BasicFlagLZStream<measure> &stream)
 	{
-		if (bufOffset>=packedSize) throw DecompressionError();
-		return bufPtr[bufOffset++];
-	};
-
-	uint8_t *dest=rawData.data();
-	size_t destOffset=0;
+		return stream.readByte();
+	}
 
-	while (destOffset!=_rawSize)
+	static void decodeToken(BasicFlagLZStream<measure> &stream,uint32_t token)
 	{
-		if (readBit())
-		{
-			uint8_t byte1=readByte();
-			uint8_t byte2=readByte();
-			uint32_t distance=(uint32_t(byte1&0xf0)<<4)|byte2;
-			uint32_t count=uint32_t(byte1&0xf)+3;
-			if (!distance || distance>destOffset) throw DecompressionError();
-			for (uint32_t i=0;i<count;i++)
-			{
-				dest[destOffset]=dest[destOffset-distance];
-				destOffset++;
-				if (destOffset==_rawSize) break;
-			}
-		} else {
-			dest[destOffset++]=readByte();
-		}
+		uint8_t byte1=stream.readByte();
+		uint8_t byte2=stream.readByte();
+		uint32_t distance=(uint32_t(byte1&0xf0)<<4)|byte2;
+		uint32_t count=uint32_t(byte1&0xf)+3;
+		if (!distance || distance>stream.destOffset) throw Decompressor::DecompressionError();
+		if (stream.destOffset+count>stream.rawSize) count=uint32_t(stream.rawSize-stream.destOffset);
+		stream.copy(distance,count);
 	}
+};
 
-	_decompressedPackedSize=bufOffset;
+// when measuring, the stream is walked through without writing anything
+template<bool measure>
+void TPWMDecompressor::decodeStream(uint8_t *dest)
+{
+	BasicFlagLZStream<measure> stream{_packedData.data(),8,_packedData.size(),dest,0,_rawSize};
+	FlagLZDecode<TPWMPolicy<measure>>(stream);
+	_decompressedPackedSize=stream.offset;
 }
 
 Decompressor::Registry<TPWMDecompressor> TPWMDecompressor::_registration;
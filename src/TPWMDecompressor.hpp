@@ -17,11 +17,16 @@ public:
 	virtual size_t getRawSize() const noexcept override final;
 
 	virtual void decompressImpl(Buffer &rawData,bool verify) override final;
+	virtual bool measureImpl() override final;
 
 	static bool detectHeader(uint32_t hdr) noexcept;
+	static bool probe(const Buffer &packedData,bool exactSizeKnown) noexcept;
 	static std::unique_ptr<Decompressor> create(const Buffer &packedData,bool exactSizeKnown,bool verify);
 
 private:
+	template<bool measure>
+	void decodeStream(uint8_t *dest);
+
 	const Buffer	&_packedData;
 
 	uint32_t	_rawSize=0;
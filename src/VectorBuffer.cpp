@@ -0,0 +1,38 @@
+/* Copyright (C) Teemu Suutari */
+
+#include "VectorBuffer.hpp"
+
+VectorBuffer::VectorBuffer()
+{
+	// nothing needed
+}
+
+VectorBuffer::~VectorBuffer()
+{
+	// nothing needed
+}
+
+const uint8_t *VectorBuffer::data() const noexcept
+{
+	return _data.data();
+}
+
+uint8_t *VectorBuffer::data()
+{
+	return _data.data();
+}
+
+size_t VectorBuffer::size() const noexcept
+{
+	return _data.size();
+}
+
+bool VectorBuffer::isResizable() const noexcept
+{
+	return true;
+}
+
+void VectorBuffer::resize(size_t newSize) 
+{
+	return _data.resize(newSize);
+}
@@ -0,0 +1,32 @@
+/* Copyright (C) Teemu Suutari */
+
+#ifndef VECTORBUFFER_HPP
+#define VECTORBUFFER_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+#include "Buffer.hpp"
+
+// Plain resizable buffer
+class VectorBuffer : public Buffer
+{
+public:
+	VectorBuffer();
+
+	virtual ~VectorBuffer() override final;
+
+	virtual const uint8_t *data() const noexcept override final;
+	virtual uint8_t *data() override final;
+	virtual size_t size() const noexcept override final;
+
+	virtual bool isResizable() const noexcept override final;
+	virtual void resize(size_t newSize) override final;
+
+private:
+	std::vector<uint8_t>  _data;
+};
+
+#endif
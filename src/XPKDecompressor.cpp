@@ -1,13 +1,98 @@
 /* Copyright (C) Teemu Suutari */
 
+#include <stdlib.h>
+
+#include <algorithm>
+#include <new>
+#include <vector>
+
 #include "XPKDecompressor.hpp"
 #include "XPKMaster.hpp"
 
+// Maximum number of free allocations kept per object size
+static constexpr size_t maxPooledStates=16;
+
+// Per thread, thus no locking. A state deleted in another thread than where it was created
+// simply goes into the pool of that thread. The pool is freed when the thread exits
+class StatePool
+{
+public:
+	StatePool()=default;
+	StatePool(const StatePool&)=delete;
+	StatePool& operator=(const StatePool&)=delete;
+
+	~StatePool()
+	{
+		for (auto &it : _entries)
+			for (auto ptr : it.freeList) ::free(ptr);
+	}
+
+	void *get(size_t size) noexcept
+	{
+		for (auto &it : _entries)
+		{
+			if (it.size==size && !it.freeList.empty())
+			{
+				void *ret=it.freeList.back();
+				it.freeList.pop_back();
+				return ret;
+			}
+		}
+		return nullptr;
+	}
+
+	// returns false if the allocation is not kept
+	bool put(void *ptr,size_t size)
+	{
+		auto it=std::find_if(_entries.begin(),_entries.end(),[&](const Entry &entry){return entry.size==size;});
+		if (it==_entries.end())
+		{
+			_entries.push_back(Entry{size,{ptr}});
+			return true;
+		}
+		if (it->freeList.size()>=maxPooledStates) return false;
+		it->freeList.push_back(ptr);
+		return true;
+	}
+
+private:
+	struct Entry
+	{
+		size_t			size;
+		std::vector<void*>	freeList;
+	};
+
+	std::vector<Entry>	_entries;
+};
+
+static thread_local StatePool statePool;
+
 XPKDecompressor::State::~State()
 {
 	// nothing needed
 }
 
+void *XPKDecompressor::State::operator new(size_t size)
+{
+	void *ret=statePool.get(size);
+	if (ret) return ret;
+	ret=::malloc(size);
+	if (!ret) throw std::bad_alloc();
+	return ret;
+}
+
+void XPKDecompressor::State::operator delete(void *ptr,size_t size) noexcept
+{
+	if (!ptr) return;
+	try
+	{
+		if (statePool.put(ptr,size)) return;
+	} catch (const std::exception&) {
+		// pool could not grow, just free
+	}
+	::free(ptr);
+}
+
 XPKDecompressor::XPKDecompressor(uint32_t recursionLevel) :
 	_recursionLevel(recursionLevel)
 {
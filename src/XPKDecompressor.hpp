@@ -24,6 +24,12 @@ public:
 		virtual ~State();
 
 		uint32_t getRecursionLevel() const;
+
+		// The memory of the states is recycled through a per thread pool, since a new state is needed
+		// for every file. Allocations are pooled per object size. Only the memory is recycled:
+		// every state is still constructed and destroyed normally, nothing of its contents is kept
+		static void *operator new(size_t size);
+		static void operator delete(void *ptr,size_t size) noexcept;
 	};
 
 	XPKDecompressor(const XPKDecompressor&)=delete;
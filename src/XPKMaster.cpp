@@ -8,12 +8,33 @@
 
 #include "XPKMaster.hpp"
 #include "XPKDecompressor.hpp"
+#include "Span.hpp"
 
 bool XPKMaster::detectHeader(uint32_t hdr) noexcept
 {
 	return hdr==FourCC('XPKF');
 }
 
+bool XPKMaster::probe(const Buffer &packedData,bool exactSizeKnown) noexcept
+{
+	ConstSpan packed(packedData);
+	if (packed.size()<44) return false;
+	uint32_t packedSize=packed.readBE32Unchecked(4);
+	uint32_t type=packed.readBE32Unchecked(8);
+	uint32_t rawSize=packed.readBE32Unchecked(12);
+	if (!rawSize || !packedSize || rawSize>getMaxRawSize() || packedSize>getMaxPackedSize() ||
+		(packed.read8Unchecked(32)&2) || packedSize+8>packed.size()) return false;
+
+	// header checksum is cheap, and always valid for real files
+	uint8_t check=0;
+	for (uint32_t i=0;i<36;i++) check^=packed.read8Unchecked(i);
+	if (check) return false;
+
+	for (auto &it : *_XPKDecompressors)
+		if (it.first(type)) return true;
+	return false;
+}
+
 std::unique_ptr<Decompressor> XPKMaster::create(const Buffer &packedData,bool verify,bool exactSizeKnown)
 {
 	return std::make_unique<XPKMaster>(packedData,verify,0);
@@ -217,6 +238,7 @@ std::unique_ptr<XPKDecompressor> XPKMaster::createDecompressor(uint32_t type,uin
 template <typename F>
 void XPKMaster::forEachChunk(F func) const
 {
+	ConstSpan packed(_packedData);
 	uint32_t currentOffset=0,rawSize,packedSize;
 	bool isLast=false;
 
@@ -226,9 +248,9 @@ void XPKMaster::forEachChunk(F func) const
 		{
 			if (_longHeaders)
 			{
-				value=_packedData.readBE32(currentOffset+offsetLong);
+				value=packed.readBE32(currentOffset+offsetLong);
 			} else {
-				value=uint32_t(_packedData.readBE16(currentOffset+offsetShort));
+				value=uint32_t(packed.readBE16(currentOffset+offsetShort));
 			}
 		};
 
@@ -248,7 +270,7 @@ void XPKMaster::forEachChunk(F func) const
 		ConstSubBuffer hdr(_packedData,currentOffset,chunkHeaderLen);
 		ConstSubBuffer chunk(_packedData,currentOffset+chunkHeaderLen,packedSize);
 
-		uint8_t type=_packedData.read8(currentOffset);
+		uint8_t type=packed.read8(currentOffset);
 		if (!func(hdr,chunk,rawSize,type)) return;
 		
 		if (type==15) isLast=true;